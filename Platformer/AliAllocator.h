@@ -0,0 +1,11 @@
+#pragma once
+
+// Puts Ali's memory on AllocTracker's heap, so it is counted under whatever AllocScope
+// is reading the document. The game's project settings name this header to Ali with
+// ALI_CONFIG_USER_H="AliAllocator.h"; without it Ali uses plain malloc.
+
+#include "AllocTracker.h"
+
+#define ali_malloc(size) AllocTracker::allocate(size)
+#define ali_realloc(p, size) AllocTracker::reallocate(p, size)
+#define ali_free(p) AllocTracker::release(p)
@@ -0,0 +1,284 @@
+#include "AllocTracker.h"
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The counters are touched from inside operator new, so nothing here may allocate.
+// They are plain atomics with static storage, ready before any constructor runs.
+static std::atomic<uint64_t> allocCount[ALLOC_TAGS_N];
+static std::atomic<uint64_t> allocBytes[ALLOC_TAGS_N];
+static std::atomic<uint64_t> freeCount[ALLOC_TAGS_N];
+static std::atomic<uint64_t> freeBytes[ALLOC_TAGS_N];
+static std::atomic<uint64_t> liveBytes(0);	// all tags, for the peak
+static std::atomic<uint64_t> peakLive(0);
+
+static uint64_t frameCount = 0;	// totals at beginFrame()
+static uint64_t frameBytes = 0;
+
+static std::atomic<uint> violations(0);
+static std::atomic<int> firstViolation(-1);
+
+static thread_local int currentTag = ALLOC_OTHER;
+static thread_local bool noAllocs = false;
+
+static const char * tagNames[ALLOC_TAGS_N] =
+{
+#define ALLOC_TAG(id, name) name,
+	ALLOC_TAGS
+#undef ALLOC_TAG
+};
+
+bool AllocTracker::isEnabled()
+{
+#ifdef TRACK_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+AllocTag AllocTracker::onAlloc(size_t size)
+{
+	AllocTag tag = (AllocTag)currentTag;
+	allocCount[tag].fetch_add(1, std::memory_order_relaxed);
+	allocBytes[tag].fetch_add(size, std::memory_order_relaxed);
+	uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	uint64_t peak = peakLive.load(std::memory_order_relaxed);
+	while (live > peak && !peakLive.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+	if (noAllocs)
+	{
+		int none = -1;
+		firstViolation.compare_exchange_strong(none, tag);
+		violations++;
+	}
+	return tag;
+}
+
+void AllocTracker::onFree(size_t size, AllocTag tag)
+{
+	freeCount[tag].fetch_add(1, std::memory_order_relaxed);
+	freeBytes[tag].fetch_add(size, std::memory_order_relaxed);
+	liveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+AllocTag AllocTracker::getTag()
+{
+	return (AllocTag)currentTag;
+}
+
+void AllocTracker::setTag(AllocTag tag)
+{
+	currentTag = tag;
+}
+
+const char * AllocTracker::getTagName(AllocTag tag)
+{
+	return tagNames[tag];
+}
+
+AllocStats AllocTracker::getTotal(AllocTag tag)
+{
+	AllocStats s;
+	s.count = allocCount[tag].load(std::memory_order_relaxed);
+	s.bytes = allocBytes[tag].load(std::memory_order_relaxed);
+	s.frees = freeCount[tag].load(std::memory_order_relaxed);
+	s.live = s.bytes - freeBytes[tag].load(std::memory_order_relaxed);
+	return s;
+}
+
+AllocStats AllocTracker::getTotal()
+{
+	AllocStats s = { 0, 0, 0, 0 };
+	for (int i = 0; i < ALLOC_TAGS_N; i++)
+	{
+		AllocStats t = getTotal((AllocTag)i);
+		s.count += t.count;
+		s.bytes += t.bytes;
+		s.frees += t.frees;
+		s.live += t.live;
+	}
+	return s;
+}
+
+// Most bytes live at once since the start or the last resetPeakLive().
+uint64_t AllocTracker::getPeakLive()
+{
+	return peakLive.load(std::memory_order_relaxed);
+}
+
+void AllocTracker::resetPeakLive()
+{
+	peakLive.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void AllocTracker::beginFrame()
+{
+	AllocStats s = getTotal();
+	frameCount = s.count;
+	frameBytes = s.bytes;
+}
+
+uint64_t AllocTracker::getFrameAllocs()
+{
+	return getTotal().count - frameCount;
+}
+
+uint64_t AllocTracker::getFrameBytes()
+{
+	return getTotal().bytes - frameBytes;
+}
+
+void AllocTracker::setNoAllocs(bool on)
+{
+	noAllocs = on;
+}
+
+uint AllocTracker::getViolations()
+{
+	return violations;
+}
+
+AllocTag AllocTracker::getFirstViolation()
+{
+	int tag = firstViolation;
+	return tag < 0 ? ALLOC_OTHER : (AllocTag)tag;
+}
+
+void AllocTracker::printReport()
+{
+	if (!isEnabled())
+		return;
+	for (int i = 0; i < ALLOC_TAGS_N; i++)
+	{
+		AllocStats s = getTotal((AllocTag)i);
+		printf("Allocations %s: %llu (%llu KB), %llu freed, %llu KB live.\n", tagNames[i],
+			(unsigned long long)s.count, (unsigned long long)(s.bytes >> 10), (unsigned long long)s.frees, (unsigned long long)(s.live >> 10));
+	}
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+// Every block carries its size and tag in front, so delete can credit the right counters.
+// 16 bytes keep the user pointer aligned like malloc's.
+struct AllocHeader
+{
+	size_t size;
+	size_t tag;
+};
+static_assert(sizeof(AllocHeader) == 16 || sizeof(void *) == 4, "AllocHeader alignment");
+
+static void * trackedAlloc(size_t size)
+{
+	AllocHeader * h = (AllocHeader *)malloc(sizeof(AllocHeader) + size);
+	if (h == NULL)
+		return NULL;
+	h->size = size;
+	h->tag = AllocTracker::onAlloc(size);
+	return h + 1;
+}
+
+static void trackedFree(void * p)
+{
+	if (p == NULL)
+		return;
+	AllocHeader * h = (AllocHeader *)p - 1;
+	AllocTracker::onFree(h->size, (AllocTag)h->tag);
+	free(h);
+}
+
+void * AllocTracker::allocate(size_t size)
+{
+	return trackedAlloc(size);
+}
+
+void * AllocTracker::reallocate(void * p, size_t size)
+{
+	if (p == NULL)
+		return trackedAlloc(size);
+	AllocHeader * h = (AllocHeader *)p - 1;
+	void * q = trackedAlloc(size);
+	if (q == NULL)
+		return NULL; // like realloc, p is left as it was
+	memcpy(q, p, h->size < size ? h->size : size);
+	trackedFree(p);
+	return q;
+}
+
+void AllocTracker::release(void * p)
+{
+	trackedFree(p);
+}
+
+void * operator new(size_t size)
+{
+	void * p = trackedAlloc(size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	return trackedAlloc(size);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return trackedAlloc(size);
+}
+
+void operator delete(void * p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) noexcept
+{
+	trackedFree(p);
+}
+
+#else
+
+void * AllocTracker::allocate(size_t size)
+{
+	return malloc(size);
+}
+
+void * AllocTracker::reallocate(void * p, size_t size)
+{
+	return realloc(p, size);
+}
+
+void AllocTracker::release(void * p)
+{
+	free(p);
+}
+
+#endif
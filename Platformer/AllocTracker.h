@@ -0,0 +1,85 @@
+#pragma once
+
+class AllocTracker;
+class AllocScope;
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+// Uncomment (or define in the project settings) to route the global new/delete through
+// AllocTracker. Without it the tracker is still there, its counters just stay at zero.
+//#define TRACK_ALLOCATIONS
+
+// What the allocating code was doing, set with AllocScope. Anything outside a scope is ALLOC_OTHER.
+#define ALLOC_TAGS \
+	ALLOC_TAG(ALLOC_OTHER, "other") \
+	ALLOC_TAG(ALLOC_LOADER, "loader") \
+	ALLOC_TAG(ALLOC_ANIMATION, "animation") \
+	ALLOC_TAG(ALLOC_RENDER, "render") \
+	ALLOC_TAG(ALLOC_OBJECTS, "objects") \
+	ALLOC_TAG(ALLOC_ARENA, "arena") \
+	ALLOC_TAG(ALLOC_UI, "ui")
+
+enum AllocTag
+{
+#define ALLOC_TAG(id, name) id,
+	ALLOC_TAGS
+#undef ALLOC_TAG
+	ALLOC_TAGS_N
+};
+
+struct AllocStats
+{
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t frees;
+	uint64_t live;	// bytes not freed yet
+};
+
+// Counts of everything that went through the global allocator, per tag.
+// beginFrame() starts a new per-frame delta; the totals are never reset, only the peak is.
+// A thread can forbid allocations with setNoAllocs(), any it then makes is counted
+// as a violation, which is how main's steady-state check works.
+class AllocTracker
+{
+public:
+	static bool isEnabled();
+
+	static AllocTag onAlloc(size_t size);
+	static void onFree(size_t size, AllocTag tag);
+
+	static AllocTag getTag();
+	static void setTag(AllocTag tag);
+	static const char * getTagName(AllocTag tag);
+
+	static AllocStats getTotal(AllocTag tag);
+	static AllocStats getTotal();
+	static uint64_t getPeakLive();
+	static void resetPeakLive();
+
+	static void beginFrame();
+	static uint64_t getFrameAllocs();
+	static uint64_t getFrameBytes();
+
+	static void setNoAllocs(bool on);
+	static uint getViolations();
+	static AllocTag getFirstViolation();
+
+	static void printReport();
+
+	// The tracked heap for C code that can't go through new/delete, Ali gets it through AliAllocator.h.
+	static void * allocate(size_t size);
+	static void * reallocate(void * p, size_t size);
+	static void release(void * p);
+};
+
+// Tags the allocations of the enclosing block, on this thread.
+class AllocScope
+{
+	AllocTag saved;
+public:
+	AllocScope(AllocTag tag) : saved(AllocTracker::getTag()) { AllocTracker::setTag(tag); }
+	~AllocScope() { AllocTracker::setTag(saved); }
+};
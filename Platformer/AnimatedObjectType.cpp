@@ -1,4 +1,5 @@
 #include "AnimatedObjectType.h"
+#include "DrawableObject.h"
 
 
 AnimatedObjectType::AnimatedObjectType()
@@ -6,11 +7,14 @@ AnimatedObjectType::AnimatedObjectType()
 }
 
 
-AnimatedObjectType::AnimatedObjectType(RegistratedString * name, RegistratedString * classname, Texture * texture, char * texturefile, Vector2i & size)
+AnimatedObjectType::AnimatedObjectType(RegistratedString * name, RegistratedString * classname, Texture * texture, const char * texturefile, Vector2i size)
 {
 	this->name = name;
 	this->classname = classname;
 	this->texture = texture;
+	image = NULL;
+	textureSize = 0;
+	textureMtime = 0;
 	strcpy_s(this->texturefile, 255, texturefile);
 	this->size = Vector2i(size);
 	uid = classname->UID()*ANIM_CLASS_MULTIPLIER + name->UID();
@@ -19,12 +23,65 @@ AnimatedObjectType::AnimatedObjectType(RegistratedString * name, RegistratedStri
 AnimatedObjectType::~AnimatedObjectType()
 {
 	delete texture;
-	anims.clear();
+	delete image;
+	for (size_t i = 0; i < clips.size(); i++)
+		delete clips[i];
 }
 
+// Clips are only ever appended, so indices held by instances stay valid across reloads.
 void AnimatedObjectType::addAnimation(Animation * a)
 {
-	anims.push(a);
+	clips.push_back(a);
+	clipUIDs.push_back(a->UID());
+}
+
+Animation * AnimatedObjectType::getAnimation(uint uid)
+{
+	int i = getAnimationIndex(uid);
+	return i < 0 ? NULL : clips[i];
+}
+
+int AnimatedObjectType::getAnimationIndex(uint uid)
+{
+	for (size_t i = 0; i < clipUIDs.size(); i++)
+		if (clipUIDs[i] == uid)
+			return (int)i;
+	return -1;
+}
+
+int AnimatedObjectType::getAnimationCount()
+{
+	return (int)clips.size();
+}
+
+Animation * AnimatedObjectType::getAnimationAt(int index)
+{
+	return clips[index];
+}
+
+uint AnimatedObjectType::addInstance(DrawableObject * o)
+{
+	instances.push_back(o);
+	return (uint)instances.size() - 1;
+}
+
+void AnimatedObjectType::removeInstance(uint index)
+{
+	if (index >= instances.size())
+		return;
+	instances[index] = instances.back();
+	instances[index]->setInstanceIndex(index);
+	instances.pop_back();
+}
+
+void AnimatedObjectType::reserveInstances(uint n)
+{
+	instances.reserve(instances.size() + n);
+}
+
+std::vector<DrawableObject *> * AnimatedObjectType::getInstances()
+{
+	return &instances;
 }
 
 uint AnimatedObjectType::UID()
@@ -52,20 +109,63 @@ Vector2i AnimatedObjectType::getSize()
 	return size;
 }
 
-int AnimatedObjectType::copyAnimations(Animation *** animations)
+void AnimatedObjectType::setSize(Vector2i size)
 {
-	this;
-	int n = anims.getSize();
-	*animations = new Animation *[n];
+	this->size = size;
+}
 
-	int i = 0;
-	for (Animation * a = anims.startLoopObj(); a != NULL; a = anims.nextStepObj())
-		(*animations)[i++] = new Animation(*a);
+const char * AnimatedObjectType::getTextureFile()
+{
+	return texturefile;
+}
 
-	return n;
+void AnimatedObjectType::setTextureFile(const char * file)
+{
+	strcpy_s(texturefile, 255, file);
 }
 
 void AnimatedObjectType::loadTexture()
 {
+	if (!AnimationCook::getSourceStamp(texturefile, &textureSize, &textureMtime))
+		textureSize = textureMtime = 0;
 	texture->loadFromFile(texturefile);
 }
+
+// Reading and decoding the file is the slow part of loading a texture and needs no GL,
+// so a reload does it on the watcher thread and only the upload is left for the frame.
+void AnimatedObjectType::loadImage()
+{
+	if (!AnimationCook::getSourceStamp(texturefile, &textureSize, &textureMtime))
+		textureSize = textureMtime = 0;
+	delete image;
+	image = new Image();
+	if (!image->loadFromFile(texturefile))
+	{
+		delete image;
+		image = NULL;
+	}
+}
+
+// Same file, unchanged since each of them read it.
+bool AnimatedObjectType::sameTexture(AnimatedObjectType * other)
+{
+	return strcmp(texturefile, other->texturefile) == 0 && textureSize == other->textureSize && textureMtime == other->textureMtime;
+}
+
+// Uploads the image a staged type decoded, and takes its file and stamp. Keeps the old
+// texture when the staged one could not be decoded.
+void AnimatedObjectType::loadTexture(AnimatedObjectType * staged)
+{
+	if (staged->image == NULL)
+		return;
+	setTextureFile(staged->texturefile);
+	textureSize = staged->textureSize;
+	textureMtime = staged->textureMtime;
+	texture->loadFromImage(*staged->image);
+}
+
+void AnimatedObjectType::getTextureStamp(uint64_t * size, int64_t * mtime)
+{
+	*size = textureSize;
+	*mtime = textureMtime;
+}
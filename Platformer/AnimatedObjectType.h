@@ -2,10 +2,12 @@
 
 class AnimatedObjectType;
 class RegistratedString;
+class DrawableObject;
 
 #include "Animation.h"
 #include "AnimationLoader.h"
 #include "List.h"
+#include <vector>
 //#include "GameObject.h"
 #include <SFML/Graphics.hpp>
 
@@ -18,18 +20,31 @@ private:
 	RegistratedString * name;
 	char texturefile[256];
 	Texture * texture;
+	Image * image; // decoded by a staged reload off the game thread, NULL otherwise
+	uint64_t textureSize;	// the texture file as it was when last read, so a reload
+	int64_t textureMtime;	// can tell when it was overwritten in place
 	Vector2i size;
-	List<Animation> anims;
+	std::vector<Animation *> clips;	// shared by all instances, indexed by AnimationState::clip
+	std::vector<uint> clipUIDs;		// clipUIDs[i] == clips[i]->UID()
+	std::vector<DrawableObject *> instances; // objects made from this type, patched on reload
 
 	uint uid;
 
 	AnimatedObjectType(); //so no one can create empty object
 public:
 
-	AnimatedObjectType(RegistratedString * name, RegistratedString * classname, Texture * texture, char * texturefile, Vector2i &size);
+	AnimatedObjectType(RegistratedString * name, RegistratedString * classname, Texture * texture, const char * texturefile, Vector2i size);
 	~AnimatedObjectType();
 
 	void addAnimation(Animation * a);
+	Animation * getAnimation(uint uid);
+	int getAnimationIndex(uint uid);
+	int getAnimationCount();
+	Animation * getAnimationAt(int index);
+	uint addInstance(DrawableObject * o);
+	void removeInstance(uint index);
+	void reserveInstances(uint n);
+	std::vector<DrawableObject *> * getInstances();
 	
 	// getters
 	uint UID();
@@ -37,9 +52,15 @@ public:
 	void getClassName(char * str);
 	Texture * getTexture();
 	Vector2i getSize();
+	void setSize(Vector2i size);
+	const char * getTextureFile();
+	void setTextureFile(const char * file);
 	
-	int copyAnimations(Animation *** animations);
 	void loadTexture();
+	void loadImage();
+	bool sameTexture(AnimatedObjectType * other);
+	void loadTexture(AnimatedObjectType * staged);
+	void getTextureStamp(uint64_t * size, int64_t * mtime);
 
 };
 
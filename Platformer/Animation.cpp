@@ -1,45 +1,40 @@
 #include "Animation.h"
-#include "DrawableObject.h"
 
-Animation::Animation(DrawableObject * obj, RegistratedString * _type, RegistratedString * _subtype, int _slides, uint _timespan, Texture * _texture, IntRect * _coords, Vector2i * _delta)
+// Without copyFrames the clip points at _coords and _delta, which must outlive it.
+Animation::Animation(RegistratedString * _type, RegistratedString * _subtype, int _slides, uint _timespan, Texture * _texture, const IntRect * _coords, const Vector2i * _delta, bool copyFrames)
 {
 	type = _type;
 	subtype = _subtype;
 	slides = _slides;
 	timespan = _timespan;
 	texture = _texture;
-	show_time = 0;
-	owner = obj;
-	coords = new IntRect[slides];
-	delta = new Vector2i[slides];
-	for (int i = 0; i < slides; i++)
+	ownsFrames = copyFrames;
+	if (!copyFrames)
 	{
-		coords[i] = _coords[i];
-		delta[i] = _delta[i];
+		coords = _coords;
+		delta = _delta;
+		return;
 	}
-	current_slide = 0;
-}
-
-Animation::Animation(const Animation & a)
-{
-	type = a.type;
-	subtype = a.subtype;
-	slides = a.slides;
-	timespan = a.timespan;
-	texture = a.texture;
-	show_time = 0;
-	owner = NULL;
-	coords = new IntRect[slides];
-	delta = new Vector2i[slides];
+	IntRect * c = new IntRect[slides];
+	Vector2i * d = new Vector2i[slides];
 	for (int i = 0; i < slides; i++)
 	{
-		coords[i] = a.coords[i];
-		delta[i] = a.delta[i];
+		c[i] = _coords[i];
+		d[i] = _delta[i];
 	}
+	coords = c;
+	delta = d;
 }
 
 Animation::~Animation()
 {
+	freeFrames();
+}
+
+void Animation::freeFrames()
+{
+	if (!ownsFrames)
+		return;
 	delete[] coords;
 	delete[] delta;
 }
@@ -51,39 +46,71 @@ int Animation::animationType(char * name)
 	return 0;
 }*/
 
-void Animation::setOwner(DrawableObject * o)
+uint Animation::UID()
 {
-	owner = o;
+	return type->UID()*ANIM_TYPE_MULTIPLIER + subtype->UID();
 }
 
-uint Animation::UID()
+RegistratedString * Animation::getType()
 {
-	return type->UID()*ANIM_TYPE_MULTIPLIER + subtype->UID();
+	return type;
 }
 
-void Animation::startAnimation()
+RegistratedString * Animation::getSubtype()
 {
-	show_time = 0;
-	current_slide = 0;
-	Sprite &s = owner->getSprite();
-	if (s.getTexture() != texture)
-		s.setTexture(*texture);
-	s.setTextureRect(IntRect(coords[0]));
+	return subtype;
 }
 
-bool Animation::isFinished()
+int Animation::getSlides()
 {
-	if (timespan == 0) return true;
-	return (show_time >= timespan*slides);
+	return slides;
 }
 
-void Animation::Update(uint time_elapsed)
+uint Animation::getTimespan()
 {
-	if (!(owner->isActive()) || timespan == 0) return;
-	show_time += time_elapsed;
-	current_slide = ((int)(show_time / timespan)) % slides;
-	Sprite &s = owner->getSprite();
-	if (s.getTexture() != texture)
-		s.setTexture(*texture);
-	s.setTextureRect(IntRect(coords[current_slide]));
+	return timespan;
+}
+
+Texture * Animation::getTexture()
+{
+	return texture;
+}
+
+const IntRect * Animation::getCoords()
+{
+	return coords;
+}
+
+const Vector2i * Animation::getDelta()
+{
+	return delta;
+}
+
+bool Animation::sameFrames(Animation * a)
+{
+	if (slides != a->slides || timespan != a->timespan)
+		return false;
+	for (int i = 0; i < slides; i++)
+		if (coords[i] != a->coords[i] || delta[i] != a->delta[i])
+			return false;
+	return true;
+}
+
+// Take over the frames of a reloaded animation. Names and texture stay.
+// The frames are copied, a clip read from the cook owns them from here on.
+void Animation::reload(Animation * a)
+{
+	IntRect * c = new IntRect[a->slides];
+	Vector2i * d = new Vector2i[a->slides];
+	for (int i = 0; i < a->slides; i++)
+	{
+		c[i] = a->coords[i];
+		d[i] = a->delta[i];
+	}
+	freeFrames();
+	slides = a->slides;
+	timespan = a->timespan;
+	coords = c;
+	delta = d;
+	ownsFrames = true;
 }
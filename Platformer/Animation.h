@@ -1,7 +1,6 @@
 #pragma once
 
 class Animation;
-class DrawableObject;
 
 #include "RegistratedString.h"
 #include <SFML/Graphics.hpp>
@@ -12,6 +11,9 @@ using namespace sf;
 #define ANIM_TYPE_MULTIPLIER 10000
 #define ANIM_CLASS_MULTIPLIER 10000
 
+// One animation clip of an AnimatedObjectType. Clips are shared by every object of the type
+// and are only changed by AnimationLoader on reload; what an object is currently showing
+// lives in its AnimationState.
 class Animation
 {
 	RegistratedString * type;
@@ -19,22 +21,35 @@ class Animation
 	int slides;
 	uint timespan; // 0 means static picture, no slide changes
 	Texture * texture;
-	IntRect * coords;
-	Vector2i * delta;
-	uint show_time;
-	int current_slide;
-	DrawableObject * owner;
+	const IntRect * coords;
+	const Vector2i * delta;
+	bool ownsFrames; // false while the frames are read in place from the cook
+
+	void freeFrames();
+
+	Animation(const Animation &a); // clips are shared, never copied
 public:
-	Animation(DrawableObject * obj, RegistratedString * _type, RegistratedString * _subtype, int _slides, uint _timespan, Texture * _texture, IntRect * _coords, Vector2i * _delta);
-	Animation(const Animation &a);
+	Animation(RegistratedString * _type, RegistratedString * _subtype, int _slides, uint _timespan, Texture * _texture, const IntRect * _coords, const Vector2i * _delta, bool copyFrames = true);
 	~Animation();
 
 	//static int animationType(char * name);
 	//static int animationSubType(char * name);
-	void setOwner(DrawableObject * o);
 	uint UID();
-	void startAnimation();
-	bool isFinished();
-	void Update(uint time_elapsed);
+	RegistratedString * getType();
+	RegistratedString * getSubtype();
+	int getSlides();
+	uint getTimespan();
+	Texture * getTexture();
+	const IntRect * getCoords();
+	const Vector2i * getDelta();
+	bool sameFrames(Animation * a);
+	void reload(Animation * a);
 };
 
+// Per object playback of a shared clip. Timing is kept by AnimationSystem.
+struct AnimationState
+{
+	short clip;		// index in the type's clips, -1 when nothing plays
+	short slide;
+	int slot;		// playback slot in AnimationSystem, -1 when the picture is static
+};
@@ -0,0 +1,268 @@
+#include "AnimationCook.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+// slides are read in place, so the mapped records must match SFML's layout
+static_assert(sizeof(IntRect) == 4 * sizeof(int32_t), "IntRect layout");
+static_assert(sizeof(Vector2i) == 2 * sizeof(int32_t), "Vector2i layout");
+
+static const uint32_t tableEntrySize[COOK_TABLES_N] =
+{
+	sizeof(CookString), sizeof(CookString), sizeof(CookString), sizeof(CookString),
+	sizeof(CookType), sizeof(CookAnimation), sizeof(IntRect), sizeof(Vector2i), sizeof(char)
+};
+
+AnimationCook::AnimationCook()
+{
+	for (int i = 0; i < COOK_TABLES_N; i++)
+		counts[i] = 0;
+	header = NULL;
+}
+
+AnimationCook::~AnimationCook()
+{
+	close();
+}
+
+// Size and modification time in nanoseconds (100 ns steps on Windows, since 1601).
+bool AnimationCook::getSourceStamp(const char * sourcefile, uint64_t * size, int64_t * mtime)
+{
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesExA(sourcefile, GetFileExInfoStandard, &attr))
+		return false;
+	*size = ((uint64_t)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+	*mtime = (int64_t)(((uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+	struct stat st;
+	if (stat(sourcefile, &st) != 0)
+		return false;
+	*size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+	*mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	*mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+void AnimationCook::append(CookTableId table, const void * data, uint32_t size, uint32_t count)
+{
+	const char * bytes = (const char *)data;
+	tables[table].insert(tables[table].end(), bytes, bytes + size);
+	counts[table] += count;
+}
+
+uint32_t AnimationCook::addString(const char * str)
+{
+	uint32_t offset = counts[COOK_STRINGS];
+	uint32_t len = (uint32_t)strlen(str) + 1;
+	append(COOK_STRINGS, str, len, len);
+	return offset;
+}
+
+void AnimationCook::addString(CookTableId table, uint32_t uid, const char * str)
+{
+	CookString s;
+	s.uid = uid;
+	s.str = addString(str);
+	append(table, &s, sizeof(s), 1);
+}
+
+void AnimationCook::addType(uint32_t classname, uint32_t name, const char * texture, int width, int height)
+{
+	CookType t;
+	t.classname = classname;
+	t.name = name;
+	t.texture = addString(texture);
+	t.width = width;
+	t.height = height;
+	t.first_animation = counts[COOK_ANIMATIONS];
+	t.animations = 0;
+	append(COOK_TYPES, &t, sizeof(t), 1);
+}
+
+void AnimationCook::addAnimation(uint32_t type, uint32_t subtype, uint32_t timespan, int slides, IntRect * coords, Vector2i * delta)
+{
+	if (counts[COOK_TYPES] == 0)
+		return;
+	CookAnimation a;
+	a.type = type;
+	a.subtype = subtype;
+	a.timespan = timespan;
+	a.first_slide = counts[COOK_COORDS];
+	a.slides = slides;
+	append(COOK_ANIMATIONS, &a, sizeof(a), 1);
+	append(COOK_COORDS, coords, slides * sizeof(IntRect), slides);
+	append(COOK_DELTAS, delta, slides * sizeof(Vector2i), slides);
+	((CookType *)&tables[COOK_TYPES][(counts[COOK_TYPES] - 1) * sizeof(CookType)])->animations++;
+}
+
+bool AnimationCook::write(const char * cookfile, uint64_t source_size, int64_t source_mtime)
+{
+	CookHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = COOK_MAGIC;
+	h.version = COOK_VERSION;
+	h.source_size = source_size;
+	h.source_mtime = source_mtime;
+
+	uint32_t offset = sizeof(h);
+	for (int i = 0; i < COOK_TABLES_N; i++)
+	{
+		offset = (offset + 3) & ~3u;
+		h.tables[i].offset = offset;
+		h.tables[i].count = counts[i];
+		offset += (uint32_t)tables[i].size();
+	}
+	h.file_size = offset;
+
+	// Written aside and renamed over the old cook, so a crash never leaves half a cook. Only done
+	// while no loader has the cook mapped: Windows refuses to replace a mapped file.
+	char tmpfile[260];
+	strcpy_s(tmpfile, 260, cookfile);
+	strcat_s(tmpfile, 260, ".tmp");
+	FILE * f;
+	if (fopen_s(&f, tmpfile, "wb") != 0 || f == NULL)
+	{
+		printf("Warning: cannot write cooked animations %s.\n", cookfile);
+		return false;
+	}
+	static const char padding[4] = { 0 };
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	uint32_t pos = sizeof(h);
+	for (int i = 0; i < COOK_TABLES_N && ok; i++)
+	{
+		if (h.tables[i].offset > pos)
+			ok = fwrite(padding, h.tables[i].offset - pos, 1, f) == 1;
+		if (ok && !tables[i].empty())
+			ok = fwrite(&tables[i][0], tables[i].size(), 1, f) == 1;
+		pos = h.tables[i].offset + (uint32_t)tables[i].size();
+	}
+	ok = fclose(f) == 0 && ok;
+#if defined(_WIN32)
+	ok = ok && MoveFileExA(tmpfile, cookfile, MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && rename(tmpfile, cookfile) == 0;
+#endif
+	if (!ok)
+	{
+		printf("Warning: cannot write cooked animations %s.\n", cookfile);
+		remove(tmpfile);
+	}
+	return ok;
+}
+
+bool AnimationCook::open(const char * cookfile, const char * sourcefile)
+{
+	close();
+	if (!file.open(cookfile))
+		return false;
+	header = (const CookHeader *)file.getData();
+	if (file.getSize() < sizeof(CookHeader) || header->magic != COOK_MAGIC || header->version != COOK_VERSION ||
+		header->file_size != file.getSize())
+	{
+		close();
+		return false;
+	}
+
+	uint64_t size;
+	int64_t mtime;
+	if (!getSourceStamp(sourcefile, &size, &mtime) || size != header->source_size || mtime != header->source_mtime || !validate())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+// Bounds check every table and reference once, so the loader can index the cook blindly.
+bool AnimationCook::validate()
+{
+	for (int i = 0; i < COOK_TABLES_N; i++)
+	{
+		const CookTable &t = header->tables[i];
+		if (t.offset % 4 != 0 || (uint64_t)t.offset + (uint64_t)t.count * tableEntrySize[i] > header->file_size)
+			return false;
+	}
+
+	uint32_t strings = getCount(COOK_STRINGS);
+	if (strings > 0 && getString(0)[strings - 1] != '\0')
+		return false;
+
+	for (int i = COOK_CLASSNAMES; i <= COOK_ANIMSUBTYPES; i++)
+	{
+		const CookString * s = getStrings((CookTableId)i);
+		for (uint32_t j = 0; j < getCount((CookTableId)i); j++)
+			if (s[j].uid != j + 1 || s[j].str >= strings)
+				return false;
+	}
+
+	const CookType * types = getTypes();
+	for (uint32_t i = 0; i < getCount(COOK_TYPES); i++)
+	{
+		if (types[i].classname == 0 || types[i].classname > getCount(COOK_CLASSNAMES) ||
+			types[i].name == 0 || types[i].name > getCount(COOK_NAMES) || types[i].texture >= strings ||
+			(uint64_t)types[i].first_animation + types[i].animations > getCount(COOK_ANIMATIONS))
+			return false;
+	}
+
+	if (getCount(COOK_COORDS) != getCount(COOK_DELTAS))
+		return false;
+	const CookAnimation * anims = getAnimations();
+	for (uint32_t i = 0; i < getCount(COOK_ANIMATIONS); i++)
+	{
+		if (anims[i].type == 0 || anims[i].type > getCount(COOK_ANIMTYPES) ||
+			anims[i].subtype == 0 || anims[i].subtype > getCount(COOK_ANIMSUBTYPES) ||
+			(uint64_t)anims[i].first_slide + anims[i].slides > getCount(COOK_COORDS))
+			return false;
+	}
+	return true;
+}
+
+void AnimationCook::close()
+{
+	file.close();
+	header = NULL;
+}
+
+uint32_t AnimationCook::getCount(CookTableId table)
+{
+	return header->tables[table].count;
+}
+
+const CookString * AnimationCook::getStrings(CookTableId table)
+{
+	return (const CookString *)(file.getData() + header->tables[table].offset);
+}
+
+const CookType * AnimationCook::getTypes()
+{
+	return (const CookType *)(file.getData() + header->tables[COOK_TYPES].offset);
+}
+
+const CookAnimation * AnimationCook::getAnimations()
+{
+	return (const CookAnimation *)(file.getData() + header->tables[COOK_ANIMATIONS].offset);
+}
+
+const IntRect * AnimationCook::getCoords()
+{
+	return (const IntRect *)(file.getData() + header->tables[COOK_COORDS].offset);
+}
+
+const Vector2i * AnimationCook::getDeltas()
+{
+	return (const Vector2i *)(file.getData() + header->tables[COOK_DELTAS].offset);
+}
+
+const char * AnimationCook::getString(uint32_t offset)
+{
+	return file.getData() + header->tables[COOK_STRINGS].offset + offset;
+}
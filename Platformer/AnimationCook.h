@@ -0,0 +1,113 @@
+#pragma once
+
+class AnimationCook;
+
+#include <stdint.h>
+#include <vector>
+#include "MappedFile.h"
+#include <SFML/Graphics.hpp>
+
+using namespace sf;
+
+// Cooked animation database: a flat binary image of animations.data with every
+// name reference already resolved to its UID. It is mapped and read in place: the loader
+// keeps it open while it is loaded, and the clips point at its slides.
+#define COOK_MAGIC 0x4b4f4f43 // "COOK"
+#define COOK_VERSION 2
+
+enum CookTableId
+{
+	COOK_CLASSNAMES,	// CookString
+	COOK_NAMES,			// CookString
+	COOK_ANIMTYPES,		// CookString
+	COOK_ANIMSUBTYPES,	// CookString
+	COOK_TYPES,			// CookType
+	COOK_ANIMATIONS,	// CookAnimation
+	COOK_COORDS,		// IntRect, one per slide
+	COOK_DELTAS,		// Vector2i, one per slide
+	COOK_STRINGS,		// char, NUL terminated strings back to back
+	COOK_TABLES_N
+};
+
+struct CookTable
+{
+	uint32_t offset;
+	uint32_t count;
+};
+
+struct CookHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	// the source file as it was when cooked, used to detect stale cooks
+	uint64_t source_size;
+	int64_t source_mtime; // nanoseconds, so a same-size edit within a second still counts
+	uint32_t file_size;
+	CookTable tables[COOK_TABLES_N];
+	uint32_t reserved;
+};
+
+struct CookString
+{
+	uint32_t uid;
+	uint32_t str; // offset in COOK_STRINGS
+};
+
+struct CookType
+{
+	uint32_t classname; // uid in COOK_CLASSNAMES
+	uint32_t name;		// uid in COOK_NAMES
+	uint32_t texture;	// offset in COOK_STRINGS
+	int32_t width;
+	int32_t height;
+	uint32_t first_animation;
+	uint32_t animations;
+};
+
+struct CookAnimation
+{
+	uint32_t type;		// uid in COOK_ANIMTYPES
+	uint32_t subtype;	// uid in COOK_ANIMSUBTYPES
+	uint32_t timespan;
+	uint32_t first_slide;
+	uint32_t slides;
+};
+
+class AnimationCook
+{
+	// writing
+	std::vector<char> tables[COOK_TABLES_N];
+	uint32_t counts[COOK_TABLES_N];
+
+	// reading
+	MappedFile file;
+	const CookHeader * header;
+
+	uint32_t addString(const char * str);
+	void append(CookTableId table, const void * data, uint32_t size, uint32_t count);
+	bool validate();
+
+public:
+	AnimationCook();
+	~AnimationCook();
+
+	static bool getSourceStamp(const char * sourcefile, uint64_t * size, int64_t * mtime);
+
+	// writing
+	void addString(CookTableId table, uint32_t uid, const char * str);
+	void addType(uint32_t classname, uint32_t name, const char * texture, int width, int height);
+	void addAnimation(uint32_t type, uint32_t subtype, uint32_t timespan, int slides, IntRect * coords, Vector2i * delta);
+	bool write(const char * cookfile, uint64_t source_size, int64_t source_mtime);
+
+	// reading
+	bool open(const char * cookfile, const char * sourcefile);
+	void close();
+
+	uint32_t getCount(CookTableId table);
+	const CookString * getStrings(CookTableId table);
+	const CookType * getTypes();
+	const CookAnimation * getAnimations();
+	const IntRect * getCoords();
+	const Vector2i * getDeltas();
+	const char * getString(uint32_t offset);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "StringInterner.h"
+
+// Animation and type names used from code, hashed at compile time. Game code passes
+// AK_*/TK_* keys instead of string literals; the loader resolves them by hash and checks
+// at load time that every key listed here exists in animations.data.
+
+struct AnimKey
+{
+	uint type;		// hash of the animtype name
+	uint subtype;	// hash of the animsubtype name
+};
+
+struct TypeKey
+{
+	uint classname;	// hash of the class name
+	uint name;		// hash of the type name
+};
+
+constexpr AnimKey animKey(const char * type, const char * subtype)
+{
+	return AnimKey{ hashString(type), hashString(subtype) };
+}
+
+constexpr TypeKey typeKey(const char * classname, const char * name)
+{
+	return TypeKey{ hashString(classname), hashString(name) };
+}
+
+// X(key, type, subtype)
+#define ANIMATION_KEYS(X) \
+	X(AK_IDLE_FIRST, "IDLE", "FIRST") \
+	X(AK_WALK_LEFT, "WALK", "LEFT") \
+	X(AK_WALK_RIGHT, "WALK", "RIGHT")
+
+// X(key, classname, name)
+#define TYPE_KEYS(X) \
+	X(TK_STATICBLOCK_GROUND, "StaticBlock", "Ground") \
+	X(TK_CHARACTER_JACK, "Character", "Jack")
+
+#define DECLARE_ANIM_KEY(key, type, subtype) constexpr AnimKey key = animKey(type, subtype);
+#define DECLARE_TYPE_KEY(key, classname, name) constexpr TypeKey key = typeKey(classname, name);
+ANIMATION_KEYS(DECLARE_ANIM_KEY)
+TYPE_KEYS(DECLARE_TYPE_KEY)
+#undef DECLARE_ANIM_KEY
+#undef DECLARE_TYPE_KEY
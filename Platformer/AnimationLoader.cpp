@@ -1,99 +1,450 @@
 #include "AnimationLoader.h"
 #include "ali.h"
 #include "ali_config.h"
+#include "DrawableObject.h"
+#include "FrameArena.h"
+#include "AllocTracker.h"
 #include <list>
+#include <vector>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
 
 
 
-AnimationLoader::AnimationLoader(char * xmlfile)
+// staged is set for the watcher's loader: it reads the xml into memory instead of mapping it
+// (see ALI_OPTION_INPUT_COPY) and never writes the cook. The live loader has the cook mapped,
+// which on Windows keeps it from being replaced; the next start cooks the edited xml.
+AnimationLoader::AnimationLoader(char * xmlfile, bool staged)
 {
+	AllocScope tag(ALLOC_LOADER);
 	if (xmlfile == NULL)
 		strcpy_s(xmlfilename, 256, "animations.data");
 	else
 		strcpy_s(xmlfilename, 256, xmlfile);
-	names_id_counter = 0;
-	classnames_id_counter = 0;
+	strcpy_s(cookfilename, 256, xmlfilename);
+	strcat_s(cookfilename, 256, ".cooked");
+	loaded = false;
+	watcher = NULL;
+	watching = false;
+	pending = NULL;
 
-	ali_doc_info * doc;
-	ali_element_ref doc_root = ali_open(&doc, xmlfilename, ALI_OPTION_INPUT_XML_DECLARATION, NULL);
-	if (doc == NULL)
+	// The cook is only trusted while it matches the size and time of the xml it was made from.
+	if (cooked.open(cookfilename, xmlfilename))
 	{
-		printf("Error: cannot read %s to read animations.\n", xmlfilename);
+		loadCooked();
+		loaded = true;
+		validateKeys();
 		return;
 	}
 
-	char tmp_classname[256], tmp_name[256], tmp_texture[256], tmp_type[256], tmp_subtype[256], tmp_slide[256];
-	RegistratedString * tmp_regstr;
-	uint id;
-	int w, h, ts, slides;
+	uint64_t source_size;
+	int64_t source_mtime;
+	bool stamped = AnimationCook::getSourceStamp(xmlfilename, &source_size, &source_mtime);
+	AnimationCook fresh;
+	loaded = loadXML(&fresh, staged);
+	if (loaded && stamped && !staged)
+		fresh.write(cookfilename, source_size, source_mtime);
+	if (loaded)
+		validateKeys();
+}
+
+struct AnimKeyInfo
+{
+	AnimKey key;
+	const char * type;
+	const char * subtype;
+};
+
+struct TypeKeyInfo
+{
+	TypeKey key;
+	const char * classname;
+	const char * name;
+};
+
+#define ANIM_KEY_INFO(key, type, subtype) { key, type, subtype },
+#define TYPE_KEY_INFO(key, classname, name) { key, classname, name },
+static const AnimKeyInfo animKeys[] = { ANIMATION_KEYS(ANIM_KEY_INFO) };
+static const TypeKeyInfo typeKeys[] = { TYPE_KEYS(TYPE_KEY_INFO) };
+#undef ANIM_KEY_INFO
+#undef TYPE_KEY_INFO
+
+// Every key compiled into the game must name something in the data.
+bool AnimationLoader::validateKeys()
+{
+	bool ok = true;
+	for (size_t i = 0; i < sizeof(typeKeys) / sizeof(typeKeys[0]); i++)
+	{
+		if (getAOType(typeKeys[i].key) == NULL)
+		{
+			printf("Error: type key %s/%s is not in %s.\n", typeKeys[i].classname, typeKeys[i].name, xmlfilename);
+			ok = false;
+		}
+	}
+	for (size_t i = 0; i < sizeof(animKeys) / sizeof(animKeys[0]); i++)
+	{
+		uint uid = getAnimationUID(animKeys[i].key);
+		bool found = false;
+		for (AnimatedObjectType * aotype = aotypes.startLoopObj(); aotype != NULL && !found; aotype = aotypes.nextStepObj())
+			found = aotype->getAnimation(uid) != NULL;
+		if (!found)
+		{
+			printf("Error: animation key %s/%s is not in %s.\n", animKeys[i].type, animKeys[i].subtype, xmlfilename);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+static void loadCookedStrings(AnimationCook * cook, CookTableId table, RegistratedStringTable * list)
+{
+	// validated to be dense from 1, so add() hands out the same uids
+	const CookString * strs = cook->getStrings(table);
+	for (uint i = 0; i < cook->getCount(table); i++)
+		list->add(cook->getString(strs[i].str));
+}
+
+// The names are registered and the types and clips made as objects, but the slides,
+// the bulk of the data, stay in the mapped cook.
+void AnimationLoader::loadCooked()
+{
+	loadCookedStrings(&cooked, COOK_CLASSNAMES, &classnames);
+	loadCookedStrings(&cooked, COOK_NAMES, &names);
+	loadCookedStrings(&cooked, COOK_ANIMTYPES, &animtypes);
+	loadCookedStrings(&cooked, COOK_ANIMSUBTYPES, &animsubtypes);
+
+	const CookType * types = cooked.getTypes();
+	const CookAnimation * anims = cooked.getAnimations();
+	const IntRect * coords = cooked.getCoords();
+	const Vector2i * delta = cooked.getDeltas();
+	for (uint i = 0; i < cooked.getCount(COOK_TYPES); i++)
+	{
+		const CookType &t = types[i];
+		Texture * tmp_tex = new Texture();
+		textures.push(tmp_tex);
+		AnimatedObjectType * at = new AnimatedObjectType(names.get(t.name), classnames.get(t.classname), tmp_tex, cooked.getString(t.texture), Vector2i(t.width, t.height));
+		for (uint j = t.first_animation; j < t.first_animation + t.animations; j++)
+		{
+			const CookAnimation &a = anims[j];
+			at->addAnimation(new Animation(animtypes.get(a.type), animsubtypes.get(a.subtype), a.slides, a.timespan, tmp_tex, &coords[a.first_slide], &delta[a.first_slide], false));
+		}
+		addType(at);
+	}
+}
+
+// One <animation> as a TypeBatch read it.
+struct ParsedAnimation
+{
+	const char * type;
+	const char * subtype;
+	int timespan;
+	int slides;
 	IntRect * coords;
 	Vector2i * delta;
+};
+
+// One <animatedobjecttype> as a TypeBatch read it, its animations are next to each other in the batch.
+struct ParsedType
+{
+	const char * classname;
+	const char * name;
+	const char * texture;
+	int width;
+	int height;
+	size_t firstAnimation;
+	size_t animations;
+};
+
+struct TypeSource
+{
+	const char * text;
+	uint32_t size;
+};
+
+// A run of <animatedobjecttype> elements cut out of the document by ali_skip, read on its own
+// thread as separate ali documents. Only plain data comes out, loadXML registers the strings
+// and builds the types from it afterwards, in document order, so the uids don't depend on timing.
+struct TypeBatch
+{
+	const TypeSource * sources;
+	size_t count;
+
+	FrameArena arena; // strings and slides, until the types are built
+	std::vector<ParsedType> types;
+	std::vector<ParsedAnimation> animations;
+	bool ok;
+
+	const char * keep(const char * str);
+	void read();
+};
+
+const char * TypeBatch::keep(const char * str)
+{
+	size_t length = strlen(str) + 1;
+	char * copy = arena.allocArray<char>((uint)length);
+	memcpy(copy, str, length);
+	return copy;
+}
+
+// Attribute values of a DOM node, decoded like ali_in's "^oa%s" and "^oa%d". A missing attribute leaves value alone.
+static void readAttribute(ali_dom * dom, ali_doc_info * doc, ali_node_ref node, const char * name, char * value, uint size)
+{
+	ali_text text;
+	if (ali_dom_attribute(dom, node, name, &text))
+		ali_decode(doc, text, value, size);
+}
+
+static void readAttribute(ali_dom * dom, ali_doc_info * doc, ali_node_ref node, const char * name, int * value)
+{
+	char tmp[64];
+	ali_text text;
+	if (ali_dom_attribute(dom, node, name, &text) && ali_decode(doc, text, tmp, sizeof(tmp)) > 0)
+		sscanf_s(tmp, "%d", value);
+}
+
+// Each type is read into a DOM, as its attributes aren't in any set order.
+void TypeBatch::read()
+{
+	AllocScope tag(ALLOC_LOADER);
+	char tmp_classname[256], tmp_name[256], tmp_texture[256], tmp_type[256], tmp_subtype[256], tmp_slide[256];
+	ali_node_ref dom_animatedobjecttype, dom_animation, dom_slide;
+	ok = true;
+	for (size_t n = 0; n < count; n++)
+	{
+		ali_doc_info * doc;
+		ali_open_memory(&doc, sources[n].text, sources[n].size, ALI_OPTION_NONE, NULL);
+		if (doc == NULL)
+		{
+			ok = false;
+			return;
+		}
+		ali_dom * dom = ali_dom_build(doc);
+		if (dom == NULL)
+		{
+			ok = false;
+			ali_close(doc);
+			continue;
+		}
+		dom_animatedobjecttype = ali_dom_child(dom, ali_dom_root(dom), "animatedobjecttype");
+
+		ParsedType t;
+		tmp_classname[0] = tmp_name[0] = tmp_texture[0] = '\0';
+		t.width = t.height = 0;
+		readAttribute(dom, doc, dom_animatedobjecttype, "class", tmp_classname, sizeof(tmp_classname));
+		readAttribute(dom, doc, dom_animatedobjecttype, "name", tmp_name, sizeof(tmp_name));
+		readAttribute(dom, doc, dom_animatedobjecttype, "texture", tmp_texture, sizeof(tmp_texture));
+		readAttribute(dom, doc, dom_animatedobjecttype, "width", &t.width);
+		readAttribute(dom, doc, dom_animatedobjecttype, "height", &t.height);
+		t.classname = keep(tmp_classname);
+		t.name = keep(tmp_name);
+		t.texture = keep(tmp_texture);
+		t.firstAnimation = animations.size();
+		for (dom_animation = ali_dom_child(dom, dom_animatedobjecttype, "animation"); dom_animation != 0; dom_animation = ali_dom_next(dom, dom_animation, "animation"))
+		{
+			ParsedAnimation a;
+			tmp_type[0] = tmp_subtype[0] = '\0';
+			a.timespan = a.slides = 0;
+			readAttribute(dom, doc, dom_animation, "timespan", &a.timespan);
+			readAttribute(dom, doc, dom_animation, "type", tmp_type, sizeof(tmp_type));
+			readAttribute(dom, doc, dom_animation, "subtype", tmp_subtype, sizeof(tmp_subtype));
+			readAttribute(dom, doc, dom_animation, "slides", &a.slides);
+			a.type = keep(tmp_type);
+			a.subtype = keep(tmp_subtype);
+			a.coords = arena.makeArray<IntRect>(a.slides);
+			a.delta = arena.makeArray<Vector2i>(a.slides);
+			int i = 0;
+			for (dom_slide = ali_dom_child(dom, dom_animation, "slide"); dom_slide != 0 && i < a.slides; dom_slide = ali_dom_next(dom, dom_slide, "slide"))
+			{
+				ali_decode(doc, ali_dom_content(dom, dom_slide), tmp_slide, sizeof(tmp_slide));
+				sscanf_s(tmp_slide, "%d,%d,%d,%d,%d,%d", &a.coords[i].left, &a.coords[i].top, &a.coords[i].width, &a.coords[i].height, &a.delta[i].x, &a.delta[i].y);
+				i++;
+			}
+			animations.push_back(a);
+		}
+		t.animations = animations.size() - t.firstAnimation;
+		types.push_back(t);
+
+		ali_dom_free(dom);
+		if (ali_get_error(doc) != ALI_ERROR_NONE)
+			ok = false;
+		ali_close(doc);
+	}
+}
+
+// Cores the type batches can be spread over.
+static size_t processorCount()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+bool AnimationLoader::loadXML(AnimationCook * cook, bool staged)
+{
+	ali_doc_info * doc;
+	uint32_t options = ALI_OPTION_INPUT_XML_DECLARATION | (staged ? ALI_OPTION_INPUT_COPY : 0);
+	ali_element_ref doc_root = ali_open(&doc, xmlfilename, options, NULL);
+	if (doc == NULL || doc_root == 0)
+	{
+		printf("Error: cannot read %s to read animations.\n", xmlfilename);
+		if (doc != NULL)
+			ali_close(doc);
+		return false;
+	}
+
+	// the formats read for every type and animation, compiled once for this load
+	ali_query * q_named = ali_compile("^oe%s");
+	ali_query * q_child = ali_compile("^oe");
+	if (q_named == NULL || q_child == NULL)
+	{
+		printf("Error: cannot compile the queries to read animations.\n");
+		ali_free_query(q_named);
+		ali_free_query(q_child);
+		ali_close(doc);
+		return false;
+	}
+
+	char tmp_name[256];
 	
 	ali_element_ref doc_classes = ali_in(doc, doc_root, "^e", 0, "classes");
-	while (ali_in(doc, doc_classes, "^oe%s", 0, "class", &tmp_name))
-		classnames.push(new RegistratedString(tmp_name, ++classnames_id_counter));
+	while (ali_in_query(doc, doc_classes, q_named, 0, "class", &tmp_name))
+	{
+		cook->addString(COOK_CLASSNAMES, classnames.add(tmp_name)->UID(), tmp_name);
+	}
 
 	ali_element_ref doc_animtypes = ali_in(doc, doc_root, "^e", 0, "animtypes");
-	while (ali_in(doc, doc_animtypes, "^oe%s", 0, "t", &tmp_name))
-		animtypes.push(new RegistratedString(tmp_name, ++types_id_counter));
+	while (ali_in_query(doc, doc_animtypes, q_named, 0, "t", &tmp_name))
+	{
+		cook->addString(COOK_ANIMTYPES, animtypes.add(tmp_name)->UID(), tmp_name);
+	}
 
 	ali_element_ref doc_animsubtypes = ali_in(doc, doc_root, "^e", 0, "animsubtypes");
-	while (ali_in(doc, doc_animsubtypes, "^oe%s", 0, "st", &tmp_name))
-		animsubtypes.push(new RegistratedString(tmp_name, ++subtypes_id_counter));
+	while (ali_in_query(doc, doc_animsubtypes, q_named, 0, "st", &tmp_name))
+	{
+		cook->addString(COOK_ANIMSUBTYPES, animsubtypes.add(tmp_name)->UID(), tmp_name);
+	}
 
+	// One quick pass cuts the types out of the document, then they are read in parallel.
+	std::vector<TypeSource> sources;
 	ali_element_ref doc_types = ali_in(doc, doc_root, "^e", 0, "types");
-	ali_element_ref doc_animatedobjecttype, doc_animation;
-	
+	ali_element_ref doc_animatedobjecttype;
+	while (doc_animatedobjecttype = ali_in_query(doc, doc_types, q_child, 0, "animatedobjecttype"))
+	{
+		TypeSource source;
+		if (!ali_skip(doc, doc_animatedobjecttype, &source.text, &source.size))
+			break;
+		sources.push_back(source);
+	}
 
-	while (doc_animatedobjecttype = ali_in(doc, doc_types, "^oe", 0, "animatedobjecttype"))
+	size_t threads = processorCount();
+	if (threads > sources.size() / AL_TYPES_PER_THREAD)
+		threads = sources.size() / AL_TYPES_PER_THREAD;
+	if (threads < 1)
+		threads = 1;
+	std::vector<TypeBatch *> batches(threads);
+	std::vector<Thread *> readers(threads);
+	for (size_t b = 0; b < threads; b++)
 	{
-		ali_in(doc, doc_animatedobjecttype, "^oa%s", 0, "class", &tmp_classname);
-		ali_in(doc, doc_animatedobjecttype, "^oa%s", 0, "name", &tmp_name);
-		ali_in(doc, doc_animatedobjecttype, "^oa%s", 0, "texture", &tmp_texture);
-		ali_in(doc, doc_animatedobjecttype, "^oa%d", 0, "width", &w);
-		ali_in(doc, doc_animatedobjecttype, "^oa%d", 0, "height", &h);
-		tmp_regstr = new RegistratedString(tmp_name, ++names_id_counter);
-		names.push(tmp_regstr);
-		Texture * tmp_tex = new Texture();
-		textures.push(tmp_tex);
-		AnimatedObjectType * at = new AnimatedObjectType(tmp_regstr, RegistratedString::getRSbyName(&classnames, tmp_classname), tmp_tex, tmp_texture, Vector2i(w, h));
-		while (doc_animation = ali_in(doc, doc_animatedobjecttype, "^oe", 0, "animation"))
+		size_t first = sources.size() * b / threads;
+		size_t last = sources.size() * (b + 1) / threads;
+		batches[b] = new TypeBatch();
+		batches[b]->sources = sources.empty() ? NULL : &sources[first];
+		batches[b]->count = last - first;
+		// the first batch is read on this thread
+		readers[b] = NULL;
+		if (b > 0)
 		{
-			ali_in(doc, doc_animation, "^oa%d", 0, "timespan",	&ts);
-			ali_in(doc, doc_animation, "^oa%s", 0, "type", &tmp_type);
-			ali_in(doc, doc_animation, "^oa%s", 0, "subtype", &tmp_subtype);
-			ali_in(doc, doc_animation, "^oa%d", 0, "slides", &slides);
-			coords = new IntRect[slides];
-			delta = new Vector2i[slides];
-			int i = 0;
-			while (ali_in(doc, doc_animation, "^oe%s", 0, "slide", &tmp_slide) && i < slides)
+			readers[b] = new Thread(&TypeBatch::read, batches[b]);
+			readers[b]->launch();
+		}
+	}
+	batches[0]->read();
+
+	bool ok = true;
+	for (size_t b = 0; b < threads; b++)
+	{
+		if (readers[b] != NULL)
+		{
+			readers[b]->wait();
+			delete readers[b];
+		}
+		ok = ok && batches[b]->ok;
+	}
+	// How the types are split into batches depends on the machine, so a broken type
+	// fails the whole load rather than dropping whichever batch it landed in.
+	if (!ok)
+		printf("Error: cannot read the types in %s.\n", xmlfilename);
+	for (size_t b = 0; b < threads; b++)
+	{
+		TypeBatch * batch = batches[b];
+		for (size_t i = 0; ok && i < batch->types.size(); i++)
+		{
+			const ParsedType &t = batch->types[i];
+			RegistratedString * tmp_regstr = names.add(t.name);
+			cook->addString(COOK_NAMES, tmp_regstr->UID(), t.name);
+			Texture * tmp_tex = new Texture();
+			textures.push(tmp_tex);
+			RegistratedString * tmp_class = classnames.get(t.classname);
+			AnimatedObjectType * at = new AnimatedObjectType(tmp_regstr, tmp_class, tmp_tex, t.texture, Vector2i(t.width, t.height));
+			cook->addType(tmp_class ? tmp_class->UID() : 0, tmp_regstr->UID(), t.texture, t.width, t.height);
+			for (size_t j = t.firstAnimation; j < t.firstAnimation + t.animations; j++)
 			{
-				sscanf_s(tmp_slide, "%d,%d,%d,%d,%d,%d", &coords[i].left, &coords[i].top, &coords[i].width, &coords[i].height, &delta[i].x, &delta[i].y);
-				i++;
+				const ParsedAnimation &a = batch->animations[j];
+				RegistratedString * rs_type = animtypes.get(a.type);
+				RegistratedString * rs_subtype = animsubtypes.get(a.subtype);
+				at->addAnimation(new Animation(rs_type, rs_subtype, a.slides, a.timespan*1000, tmp_tex, a.coords, a.delta));
+				cook->addAnimation(rs_type ? rs_type->UID() : 0, rs_subtype ? rs_subtype->UID() : 0, a.timespan * 1000, a.slides, a.coords, a.delta);
 			}
-			at->addAnimation(new Animation(NULL, RegistratedString::getRSbyName(&animtypes, tmp_type), RegistratedString::getRSbyName(&animsubtypes, tmp_subtype), slides, ts*1000, tmp_tex, coords, delta));
-			delete[] coords;
-			delete[] delta;
+			addType(at);
 		}
-		addType(at);
+		delete batch;
 	}
 
+	ok = ok && ali_get_error(doc) == ALI_ERROR_NONE;
+	ali_free_query(q_named);
+	ali_free_query(q_child);
 	ali_close(doc);
+	return ok;
 }
 
 AnimationLoader::~AnimationLoader()
 {
+	stopWatching();
+	delete pending;
+	textures.deform();
 	aotypes.clear();
+	typesByUID.clear();
 	classnames.clear();
 	names.clear();
 	animtypes.clear();
 	animsubtypes.clear();
-	textures.clear();
+	cooked.close(); // after the clips that point into it
 }
 
+// Types are indexed by class, then name uid, so getAOType doesn't walk the list. First one wins, like List::lookObj.
 uint AnimationLoader::addType(AnimatedObjectType * at)
 {
 	aotypes.push(at);
+	uint c = at->UID() / ANIM_CLASS_MULTIPLIER, n = at->UID() % ANIM_CLASS_MULTIPLIER;
+	if (typesByUID.size() <= c)
+		typesByUID.resize(c + 1);
+	if (typesByUID[c].size() <= n)
+		typesByUID[c].resize(n + 1, NULL);
+	if (typesByUID[c][n] == NULL)
+		typesByUID[c][n] = at;
 	return at->UID();
 }
 
@@ -105,15 +456,251 @@ void AnimationLoader::loadTextures()
 
 AnimatedObjectType * AnimationLoader::getAOType(char * classname, char * name)
 {
-	return getAOType(RegistratedString::getUIDbyName(&classnames, classname)*ANIM_CLASS_MULTIPLIER + RegistratedString::getUIDbyName(&names, name));
+	return getAOType(classnames.getUID(classname)*ANIM_CLASS_MULTIPLIER + names.getUID(name));
 }
 
 AnimatedObjectType * AnimationLoader::getAOType(uint uid)
 {
-	return aotypes.lookObj(uid);
+	uint c = uid / ANIM_CLASS_MULTIPLIER, n = uid % ANIM_CLASS_MULTIPLIER;
+	if (uid == 0 || c >= typesByUID.size() || n >= typesByUID[c].size())
+		return NULL;
+	return typesByUID[c][n];
+}
+
+AnimatedObjectType * AnimationLoader::getAOType(TypeKey key)
+{
+	return getAOType(classnames.getUIDByHash(key.classname)*ANIM_CLASS_MULTIPLIER + names.getUIDByHash(key.name));
+}
+
+uint AnimationLoader::getAnimationUID(AnimKey key)
+{
+	return animtypes.getUIDByHash(key.type)*ANIM_TYPE_MULTIPLIER + animsubtypes.getUIDByHash(key.subtype);
 }
 
 uint AnimationLoader::getAnimationUID(char * type, char * subtype)
 {
-	return RegistratedString::getUIDbyName(&animtypes, type)*ANIM_TYPE_MULTIPLIER + RegistratedString::getUIDbyName(&animsubtypes, subtype);
+	return animtypes.getUID(type)*ANIM_TYPE_MULTIPLIER + animsubtypes.getUID(subtype);
+}
+
+bool AnimationLoader::isLoaded()
+{
+	return loaded;
+}
+
+void AnimationLoader::startWatching()
+{
+	if (watcher != NULL)
+		return;
+	if (!AnimationCook::getSourceStamp(xmlfilename, &watched_size, &watched_mtime))
+		watched_size = watched_mtime = 0;
+	watchTextures(this);
+	watching = true;
+	watcher = new Thread(&AnimationLoader::watchFile, this);
+	watcher->launch();
+}
+
+void AnimationLoader::stopWatching()
+{
+	if (watcher == NULL)
+		return;
+	reloadMutex.lock();
+	watching = false;
+	reloadMutex.unlock();
+	watcher->wait();
+	delete watcher;
+	watcher = NULL;
+}
+
+bool AnimationLoader::isWatching()
+{
+	Lock lock(reloadMutex);
+	return watching;
+}
+
+// Takes the texture files of from's types and the stamps they were read with.
+void AnimationLoader::watchTextures(AnimationLoader * from)
+{
+	watchedTextures.clear();
+	for (AnimatedObjectType * at = from->aotypes.startLoopObj(); at != NULL; at = from->aotypes.nextStepObj())
+	{
+		WatchedTexture w;
+		strcpy_s(w.file, 256, at->getTextureFile());
+		at->getTextureStamp(&w.size, &w.mtime);
+		watchedTextures.push_back(w);
+	}
+}
+
+// Whether the xml or one of its textures changed since the last look. Runs on the watcher thread.
+bool AnimationLoader::sourcesChanged()
+{
+	uint64_t size;
+	int64_t mtime;
+	if (!AnimationCook::getSourceStamp(xmlfilename, &size, &mtime))
+		return false;
+	bool changed = size != watched_size || mtime != watched_mtime;
+	watched_size = size;
+	watched_mtime = mtime;
+	for (size_t i = 0; i < watchedTextures.size(); i++)
+	{
+		if (!AnimationCook::getSourceStamp(watchedTextures[i].file, &size, &mtime))
+			continue;
+		// taken right away, so a texture that fails to load is not retried every poll
+		if (size != watchedTextures[i].size || mtime != watchedTextures[i].mtime)
+			changed = true;
+		watchedTextures[i].size = size;
+		watchedTextures[i].mtime = mtime;
+	}
+	return changed;
+}
+
+void AnimationLoader::watchFile()
+{
+#if defined(__linux__)
+	// Watch the directory, not the file: editors often save by renaming a new file over the old one.
+	char dir[256];
+	strcpy_s(dir, 256, xmlfilename);
+	char * slash = strrchr(dir, '/');
+	const char * base = xmlfilename;
+	if (slash)
+	{
+		*slash = '\0';
+		base = xmlfilename + (slash - dir) + 1;
+	}
+	else
+		strcpy_s(dir, 256, ".");
+
+	int fd = inotify_init1(IN_NONBLOCK);
+	if (fd >= 0 && inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0)
+	{
+		char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		while (isWatching())
+		{
+			struct pollfd p = { fd, POLLIN, 0 };
+			if (poll(&p, 1, 250) <= 0)
+			{
+				// textures may be anywhere, their stamps are polled between events
+				reloadInBackground();
+				continue;
+			}
+			bool changed = false;
+			ssize_t len;
+			while ((len = read(fd, events, sizeof(events))) > 0)
+			{
+				for (char * e = events; e < events + len; e += sizeof(struct inotify_event) + ((struct inotify_event *)e)->len)
+				{
+					struct inotify_event * ev = (struct inotify_event *)e;
+					if (ev->len > 0 && strcmp(ev->name, base) == 0)
+						changed = true;
+				}
+			}
+			if (changed)
+				reloadInBackground();
+		}
+		close(fd);
+		return;
+	}
+	if (fd >= 0)
+		close(fd);
+#endif
+	// no change notification available, poll the file's size and time instead
+	while (isWatching())
+	{
+		sleep(milliseconds(500));
+		reloadInBackground();
+	}
+}
+
+// Runs on the watcher thread. Parsing and decoding the textures happen here, the live types are
+// only touched by applyReload().
+void AnimationLoader::reloadInBackground()
+{
+	if (!sourcesChanged())
+		return;
+
+	AnimationLoader * staged = new AnimationLoader(xmlfilename, true);
+	if (!staged->isLoaded())
+	{
+		printf("Error: %s changed but cannot be read, keeping the old animations.\n", xmlfilename);
+		delete staged;
+		return;
+	}
+	for (AnimatedObjectType * st = staged->aotypes.startLoopObj(); st != NULL; st = staged->aotypes.nextStepObj())
+		st->loadImage();
+	watchTextures(staged);
+
+	reloadMutex.lock();
+	AnimationLoader * old = pending;
+	pending = staged;
+	reloadMutex.unlock();
+	delete old;
+}
+
+// Diff the last staged reload against the live types and patch only what changed.
+// Called by the game thread at a frame boundary; returns immediately when nothing is pending.
+void AnimationLoader::applyReload()
+{
+	reloadMutex.lock();
+	AnimationLoader * staged = pending;
+	pending = NULL;
+	reloadMutex.unlock();
+	if (staged == NULL)
+		return;
+
+	AllocScope tag(ALLOC_LOADER);
+	char classname[256], name[256];
+	int changes = 0;
+	for (AnimatedObjectType * st = staged->aotypes.startLoopObj(); st != NULL; st = staged->aotypes.nextStepObj())
+	{
+		st->getClassName(classname);
+		st->getName(name);
+		AnimatedObjectType * live = getAOType(classname, name);
+		if (live == NULL)
+		{
+			// the name may already be registered for another class, the lookup above uses the first uid
+			RegistratedString * rs_name = names.registerName(name);
+			Texture * tex = new Texture();
+			textures.push(tex);
+			live = new AnimatedObjectType(rs_name, classnames.registerName(classname), tex, st->getTextureFile(), st->getSize());
+			live->loadTexture(st);
+			addType(live);
+			changes++;
+		}
+		else
+		{
+			// the Texture object is shared by every sprite of the type, so reloading it patches them all;
+			// a file overwritten in place counts as changed too
+			if (!live->sameTexture(st))
+			{
+				live->loadTexture(st);
+				changes++;
+			}
+			live->setSize(st->getSize());
+		}
+
+		for (int i = 0; i < st->getAnimationCount(); i++)
+		{
+			Animation * sa = st->getAnimationAt(i);
+			RegistratedString * rs_type = animtypes.registerName(sa->getType()->getStr());
+			RegistratedString * rs_subtype = animsubtypes.registerName(sa->getSubtype()->getStr());
+			Animation * la = live->getAnimation(rs_type->UID()*ANIM_TYPE_MULTIPLIER + rs_subtype->UID());
+			if (la == NULL)
+			{
+				// instances share the type's clips, so a new clip is playable right away
+				live->addAnimation(new Animation(rs_type, rs_subtype, sa->getSlides(), sa->getTimespan(), live->getTexture(), sa->getCoords(), sa->getDelta()));
+				changes++;
+				continue;
+			}
+			if (la->sameFrames(sa))
+				continue;
+			la->reload(sa);
+
+			// the clip is patched in place for everyone, objects showing it restart
+			std::vector<DrawableObject *> * instances = live->getInstances();
+			for (size_t j = 0; j < instances->size(); j++)
+				(*instances)[j]->reloadAnimation(la);
+			changes++;
+		}
+	}
+	delete staged;
+	printf("Reloaded %s: %d change(s).\n", xmlfilename, changes);
 }
@@ -9,40 +9,78 @@ class AnimationLoader;
 //#include "GameManager.h"
 #include "AnimatedObjectType.h"
 #include "RegistratedString.h"
+#include "AnimationCook.h"
+#include "AnimationKeys.h"
 #include <SFML/Graphics.hpp>
+#include <vector>
 
 #define AL_CLASS_MULTIPLIER 10000
+#define AL_TYPES_PER_THREAD 64 // below this many types per thread, loading uses fewer threads
 
 using namespace sf;
 
 class AnimationLoader
 {
 	char xmlfilename[256]; // default: "animations.data"
+	char cookfilename[256]; // xmlfilename + ".cooked"
 
-	uint names_id_counter;
-	uint classnames_id_counter;
-	uint types_id_counter;
-	uint subtypes_id_counter;
-	
-	List<AnimatedObjectType> aotypes;
-	List<RegistratedString> classnames;
-	List<RegistratedString> names;
+	OwningList<AnimatedObjectType> aotypes; // each type owns its clips and texture
+	std::vector<std::vector<AnimatedObjectType *> > typesByUID; // [uid / ANIM_CLASS_MULTIPLIER][uid % ANIM_CLASS_MULTIPLIER]
+	RegistratedStringTable classnames;
+	RegistratedStringTable names;
 
-	List<RegistratedString> animtypes;
-	List<RegistratedString> animsubtypes;
+	RegistratedStringTable animtypes;
+	RegistratedStringTable animsubtypes;
 
-	ListWithoutUID<Texture> textures;
+	ListWithoutUID<Texture> textures; // owned by the types
+	AnimationCook cooked; // kept mapped while loaded from it, the clips' slides point into it
+
+	bool loaded;
+
+	// hot reload: the watcher thread parses changed xml into a staging loader,
+	// the game thread diffs it into this one in applyReload()
+	Thread * watcher;
+	Mutex reloadMutex;
+	bool watching;
+	AnimationLoader * pending;
+	uint64_t watched_size;
+	int64_t watched_mtime;
+	struct WatchedTexture
+	{
+		char file[256];
+		uint64_t size;
+		int64_t mtime;
+	};
+	std::vector<WatchedTexture> watchedTextures; // the watcher thread's own copy, textures may be in any directory
 
 	AnimationLoader();
+
+	bool loadXML(AnimationCook * cook, bool staged);
+	void loadCooked();
+	bool validateKeys();
+
+	bool isWatching();
+	void watchTextures(AnimationLoader * from);
+	bool sourcesChanged();
+	void watchFile();
+	void reloadInBackground();
 public:
 		
-	AnimationLoader(char * xmlfile);
+	AnimationLoader(char * xmlfile, bool staged = false);
 	~AnimationLoader();
 
 	uint addType(AnimatedObjectType *at);
 	void loadTextures();
+	bool isLoaded();
+
+	void startWatching();
+	void stopWatching();
+	void applyReload();
+
 	AnimatedObjectType * getAOType(char * classname, char * name);
 	AnimatedObjectType * getAOType(uint uid);
+	AnimatedObjectType * getAOType(TypeKey key);
 	uint getAnimationUID(char * type, char * subtype);
+	uint getAnimationUID(AnimKey key);
 };
 
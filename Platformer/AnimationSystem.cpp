@@ -0,0 +1,259 @@
+#include "AnimationSystem.h"
+#include "DrawableObject.h"
+#include "Animation.h"
+#include "AllocTracker.h"
+#include <algorithm>
+
+AnimationSystem::AnimationSystem()
+{
+	for (int i = 0; i < WHEEL_LEVELS * WHEEL_SIZE; i++)
+		buckets[i] = -1;
+	now = 0;
+	tick = 0;
+	cascaded = 0;
+	lazy = false;
+}
+
+AnimationSystem::~AnimationSystem()
+{
+}
+
+// Starts a at its first slide, reusing the object's slot when it already has one.
+int AnimationSystem::play(DrawableObject * o, Animation * a, bool rep, int slot)
+{
+	AllocScope tag(ALLOC_ANIMATION);
+	if (slot < 0)
+	{
+		slot = (int)playbacks.size();
+		playbacks.push_back(Playback());
+		playbacks[slot].bucket = -1;
+	}
+	else
+		unschedule(slot);
+	Playback &p = playbacks[slot];
+	p.start = now;
+	p.timespan = a->getTimespan();
+	p.deadline = now + p.timespan;
+	p.slides = a->getSlides();
+	p.slide = 0;
+	p.repeat = rep;
+	p.owner = o;
+	if (!lazy)
+		schedule(slot);
+	else if (!rep)
+		scheduleEnd(slot);
+	return slot;
+}
+
+// Frees slot by moving the last playback into it.
+void AnimationSystem::stop(int slot)
+{
+	int last = (int)playbacks.size() - 1;
+	if (slot < 0 || slot > last)
+		return;
+	unschedule(slot);
+	if (slot != last)
+	{
+		unschedule(last);
+		playbacks[slot] = playbacks[last];
+		playbacks[slot].owner->setAnimationSlot(slot);
+		if (!lazy || !playbacks[slot].repeat)
+			schedule(slot);
+	}
+	playbacks.pop_back();
+}
+
+void AnimationSystem::schedule(int slot)
+{
+	Playback &p = playbacks[slot];
+	uint64_t due = p.deadline >> WHEEL_TICK_SHIFT;
+	if (due < tick)
+		due = tick;
+	uint64_t delta = due - tick;
+	int level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+		level++;
+	if (delta >= ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)))
+		due = tick + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1; // cascades back down later
+	int bucket = level * WHEEL_SIZE + (int)((due >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+	p.bucket = bucket;
+	p.prev = -1;
+	p.next = buckets[bucket];
+	if (p.next >= 0)
+		playbacks[p.next].prev = slot;
+	buckets[bucket] = slot;
+}
+
+// Lazy mode: wakes a one-shot playback only when its last slide is over, to retire it.
+void AnimationSystem::scheduleEnd(int slot)
+{
+	Playback &p = playbacks[slot];
+	p.deadline = p.start + (uint64_t)p.slides * p.timespan;
+	schedule(slot);
+}
+
+void AnimationSystem::unschedule(int slot)
+{
+	Playback &p = playbacks[slot];
+	if (p.bucket < 0)
+		return;
+	if (p.prev >= 0)
+		playbacks[p.prev].next = p.next;
+	else
+		buckets[p.bucket] = p.next;
+	if (p.next >= 0)
+		playbacks[p.next].prev = p.prev;
+	p.bucket = -1;
+}
+
+// Moves the current bucket of level down to the finer levels.
+void AnimationSystem::cascade(int level)
+{
+	int bucket = level * WHEEL_SIZE + (int)((tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+	int slot = buckets[bucket];
+	buckets[bucket] = -1;
+	while (slot >= 0)
+	{
+		int next = playbacks[slot].next;
+		playbacks[slot].bucket = -1;
+		schedule(slot);
+		slot = next;
+	}
+}
+
+void AnimationSystem::runBucket(int bucket)
+{
+	// detach first, fire() may schedule into this very bucket again
+	int slot = buckets[bucket];
+	buckets[bucket] = -1;
+	while (slot >= 0)
+	{
+		int next = playbacks[slot].next;
+		playbacks[slot].bucket = -1;
+		if (playbacks[slot].deadline <= now)
+			fire(slot);
+		else
+			schedule(slot); // due later in the current tick
+		slot = next;
+	}
+}
+
+// Slides are counted from the start, so late or long frames never drift
+// and the lazy and scheduled paths always agree.
+int AnimationSystem::currentSlide(Playback &p, uint64_t * passed, bool * finished)
+{
+	*passed = (now - p.start) / p.timespan;
+	*finished = *passed >= (uint64_t)p.slides && !p.repeat;
+	if (*finished)
+		return p.slides - 1;
+	return (int)(*passed % p.slides);
+}
+
+void AnimationSystem::fire(int slot)
+{
+	Playback &p = playbacks[slot];
+	uint64_t passed;
+	bool finished;
+	int s = currentSlide(p, &passed, &finished);
+	if (s != p.slide && p.owner->isActive())
+	{
+		Change c = { p.owner, s };
+		changed.push_back(c);
+	}
+	p.slide = s;
+	if (finished)
+	{
+		// freeing now would move slots around under runBucket()
+		this->finished.push_back(slot);
+		return;
+	}
+	p.deadline = p.start + (passed + 1) * p.timespan;
+	schedule(slot);
+}
+
+void AnimationSystem::update(uint time_elapsed)
+{
+	AllocScope tag(ALLOC_ANIMATION);
+	changed.clear();
+	now += time_elapsed;
+	uint64_t last = now >> WHEEL_TICK_SHIFT;
+	// the last tick stays open: it is run again next frame for what falls due later in it
+	for (;; tick++)
+	{
+		if (cascaded <= tick)
+		{
+			for (int level = 1; level < WHEEL_LEVELS && (tick & (((uint64_t)1 << (WHEEL_BITS * level)) - 1)) == 0; level++)
+				cascade(level);
+			cascaded = tick + 1;
+		}
+		runBucket((int)(tick & WHEEL_MASK));
+		if (tick >= last)
+			break;
+	}
+
+	// highest first, so stop() never moves a slot that is still waiting here
+	std::sort(finished.begin(), finished.end());
+	for (int i = (int)finished.size() - 1; i >= 0; i--)
+	{
+		playbacks[finished[i]].owner->setAnimationSlot(-1);
+		stop(finished[i]);
+	}
+	finished.clear();
+}
+
+void AnimationSystem::applyChanges()
+{
+	for (size_t i = 0; i < changed.size(); i++)
+		changed[i].owner->setSlide(changed[i].slide);
+}
+
+void AnimationSystem::setLazy(bool on)
+{
+	if (on == lazy)
+		return;
+	lazy = on;
+	for (int i = 0; i < (int)playbacks.size(); i++)
+	{
+		unschedule(i);
+		if (lazy)
+		{
+			if (!playbacks[i].repeat)
+				scheduleEnd(i);
+		}
+		else
+		{
+			// due at once, and slide is stale after lazy mode: the next update() redoes every sprite
+			playbacks[i].deadline = now;
+			playbacks[i].slide = -1;
+			schedule(i);
+		}
+	}
+}
+
+bool AnimationSystem::isLazy()
+{
+	return lazy;
+}
+
+int AnimationSystem::slideAt(int slot)
+{
+	uint64_t passed;
+	bool finished;
+	return currentSlide(playbacks[slot], &passed, &finished);
+}
+
+uint64_t AnimationSystem::getTime()
+{
+	return now;
+}
+
+uint AnimationSystem::getCount()
+{
+	return (uint)playbacks.size();
+}
+
+uint AnimationSystem::getChangedCount()
+{
+	return (uint)changed.size();
+}
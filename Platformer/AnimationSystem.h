@@ -0,0 +1,81 @@
+#pragma once
+
+class AnimationSystem;
+class DrawableObject;
+class Animation;
+
+#include <vector>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define WHEEL_TICK_SHIFT 10		// one wheel tick is 1024 microseconds
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4			// 64^4 ticks, about 4.7 hours ahead
+
+// Drives every playing animation. Each playback sits in a hierarchical timing wheel under
+// the time of its next slide change, so a frame only visits the playbacks whose slide
+// actually changes; objects showing a static picture take no slot at all.
+// update() collects the objects whose frame changed, applyChanges() then touches only
+// their sprites.
+// In lazy mode a looping playback is just its start time, and the object asks slideAt()
+// when it is drawn, so objects that are not drawn cost nothing. One-shot playbacks still
+// sit in the wheel, once, under their end time, so their slots are freed when they finish.
+class AnimationSystem
+{
+	struct Playback
+	{
+		uint64_t start;		// absolute time the clip started
+		uint64_t deadline;	// absolute time of the next slide change
+		uint timespan;
+		int slides;
+		int slide;
+		bool repeat;
+		DrawableObject * owner;
+		int bucket;			// wheel bucket, -1 when not scheduled
+		int prev, next;		// neighbours in the bucket
+	};
+
+	struct Change
+	{
+		DrawableObject * owner;
+		int slide;
+	};
+
+	std::vector<Playback> playbacks;	// index is the slot
+	int buckets[WHEEL_LEVELS * WHEEL_SIZE];
+	uint64_t now;
+	uint64_t tick;			// first wheel tick not completely processed
+	uint64_t cascaded;		// tick whose cascade already ran, +1
+	bool lazy;
+
+	std::vector<Change> changed;
+	std::vector<int> finished;	// slots to free once the wheel is idle
+
+	void schedule(int slot);
+	void unschedule(int slot);
+	void cascade(int level);
+	void runBucket(int bucket);
+	void fire(int slot);
+	void scheduleEnd(int slot);
+	int currentSlide(Playback &p, uint64_t * passed, bool * finished);
+public:
+	AnimationSystem();
+	~AnimationSystem();
+
+	int play(DrawableObject * o, Animation * a, bool repeat, int slot = -1);
+	void stop(int slot);
+
+	void update(uint time_elapsed);
+	void applyChanges();
+
+	void setLazy(bool on);
+	bool isLazy();
+	int slideAt(int slot);
+
+	uint64_t getTime();
+	uint getCount();
+	uint getChangedCount();
+};
@@ -0,0 +1,235 @@
+// Ali benchmark and fuzz harness. Builds from Ali and AllocTracker alone, without SFML or the game:
+//   AliBench.exe from Bench/AliBench.cpp, ali.cpp and AllocTracker.cpp;
+//   add TRACK_ALLOCATIONS and ALI_CONFIG_USER_H="AliAllocator.h" to count Ali's allocations.
+// Defining ALI_LIBFUZZER leaves out main, for libFuzzer to drive LLVMFuzzerTestOneInput:
+//   clang++ -g -O1 -fsanitize=fuzzer,address -DALI_LIBFUZZER Bench/AliBench.cpp ali.cpp AllocTracker.cpp
+//
+// --bench [types] [depth] [file]: reads a generated animations.data with ali_open_memory + ali_in,
+// the way the loader used to, and prints MB/s, allocations per read and the peak heap of a read
+// (the last two need the allocator settings above).
+// With a file the document is also written out, to seed a fuzzer's corpus.
+// --bench-open [types] [depth] [file]: the same, written to file (ali_bench.xml by default) and
+// opened with ali_open for every read, so the mapping or reading of the file is timed as well.
+// --fuzz file: runs one input through ali_in, ali_parse and ali_dom_build, for AFL-style
+// fuzzers that pass a file (afl-fuzz -i corpus -o findings -- AliBench --fuzz @@).
+#include "../ali_config.h"
+#include "../ali.h"
+#include "../AllocTracker.h"
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#define ALI_BENCH_TYPES 1000
+#define ALI_BENCH_DEPTH 8
+#define ALI_BENCH_BYTES (64 << 20) // read about this much per run, whatever the document size
+#define ALI_BENCH_FILE "ali_bench.xml"
+
+// Same layout as animations.data, with entities in the names and each type carrying a note
+// nested depth levels deep, which nothing reads and so has to be skipped.
+static void makeAliDocument(std::string &xml, uint types, uint depth)
+{
+	char tmp[256];
+	xml = "<?xml version=\"1.0\" ?>\n<classes>\n\t<class>StaticBlock</class>\n\t<class>Char&amp;acter</class>\n</classes>\n"
+		"<animtypes>\n\t<t>IDLE</t>\n\t<t>WALK</t>\n</animtypes>\n<animsubtypes>\n\t<st>LEFT</st>\n\t<st>RIGHT</st>\n</animsubtypes>\n<types>\n";
+	for (uint i = 0; i < types; i++)
+	{
+		sprintf_s(tmp, "\t<animatedobjecttype class=\"%s\" name=\"T%u&lt;&#65;&gt;\" texture=\"images/t%u.png\" width=\"%u\" height=\"%u\">\n",
+			i % 2 ? "Char&amp;acter" : "StaticBlock", i, i, 10 + i % 50, 20 + i % 30);
+		xml += tmp;
+		for (uint d = 0; d < depth; d++)
+			xml += "<group>";
+		xml += "<note>skipped &amp; never read &#x263A;</note>";
+		for (uint d = 0; d < depth; d++)
+			xml += "</group>";
+		xml += "\n";
+		for (uint j = 0; j < 1 + i % 3; j++)
+		{
+			sprintf_s(tmp, "\t\t<animation timespan=\"%u\" type=\"%s\" subtype=\"%s\" slides=\"4\">\n", 100 * j, j ? "WALK" : "IDLE", j % 2 ? "LEFT" : "RIGHT");
+			xml += tmp;
+			for (uint k = 0; k < 4; k++)
+			{
+				sprintf_s(tmp, "\t\t\t<slide>%u,%u,80,96,0,0</slide>\n", k * 80, j * 96);
+				xml += tmp;
+			}
+			xml += "\t\t</animation>\n";
+		}
+		xml += "\t</animatedobjecttype>\n";
+	}
+	xml += "</types>\n";
+}
+
+// Everything the loader reads, through ali_in, then closes doc. Returns the number of types,
+// -1 when the document is bad.
+static int readAliDocument(ali_doc_info * doc, ali_element_ref doc_root)
+{
+	char tmp[256];
+	int n, types = 0;
+	if (doc == NULL)
+		return -1;
+	ali_element_ref doc_classes = ali_in(doc, doc_root, "^e", 0, "classes");
+	while (ali_in(doc, doc_classes, "^oe%255s", 0, "class", &tmp));
+	ali_element_ref doc_animtypes = ali_in(doc, doc_root, "^e", 0, "animtypes");
+	while (ali_in(doc, doc_animtypes, "^oe%255s", 0, "t", &tmp));
+	ali_element_ref doc_animsubtypes = ali_in(doc, doc_root, "^e", 0, "animsubtypes");
+	while (ali_in(doc, doc_animsubtypes, "^oe%255s", 0, "st", &tmp));
+	ali_element_ref doc_types = ali_in(doc, doc_root, "^e", 0, "types");
+	ali_element_ref doc_animatedobjecttype, doc_animation;
+	while (doc_animatedobjecttype = ali_in(doc, doc_types, "^oe", 0, "animatedobjecttype"))
+	{
+		ali_in(doc, doc_animatedobjecttype, "^oa%255s", 0, "class", &tmp);
+		ali_in(doc, doc_animatedobjecttype, "^oa%255s", 0, "name", &tmp);
+		ali_in(doc, doc_animatedobjecttype, "^oa%255s", 0, "texture", &tmp);
+		ali_in(doc, doc_animatedobjecttype, "^oa%d", 0, "width", &n);
+		ali_in(doc, doc_animatedobjecttype, "^oa%d", 0, "height", &n);
+		while (doc_animation = ali_in(doc, doc_animatedobjecttype, "^oe", 0, "animation"))
+		{
+			ali_in(doc, doc_animation, "^oa%d", 0, "timespan", &n);
+			ali_in(doc, doc_animation, "^oa%255s", 0, "type", &tmp);
+			ali_in(doc, doc_animation, "^oa%255s", 0, "subtype", &tmp);
+			ali_in(doc, doc_animation, "^oa%d", 0, "slides", &n);
+			while (ali_in(doc, doc_animation, "^oe%255s", 0, "slide", &tmp));
+		}
+		types++;
+	}
+	if (ali_get_error(doc) != ALI_ERROR_NONE)
+		types = -1;
+	ali_close(doc);
+	return types;
+}
+
+static int runAliBench(int argc, char ** argv, bool open)
+{
+	uint types = argc > 2 ? (uint)atoi(argv[2]) : ALI_BENCH_TYPES;
+	uint depth = argc > 3 ? (uint)atoi(argv[3]) : ALI_BENCH_DEPTH;
+	const char * file = argc > 4 ? argv[4] : (open ? ALI_BENCH_FILE : NULL);
+	std::string xml;
+	makeAliDocument(xml, types, depth);
+	if (file != NULL)
+	{
+		FILE * f;
+		if (fopen_s(&f, file, "wb") != 0)
+		{
+			printf("Error: cannot write %s.\n", file);
+			return 1;
+		}
+		fwrite(xml.data(), 1, xml.size(), f);
+		fclose(f);
+	}
+
+	uint runs = (uint)(ALI_BENCH_BYTES / xml.size()) + 1;
+	AllocStats before = AllocTracker::getTotal();
+	AllocTracker::resetPeakLive();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint i = 0; i < runs; i++)
+	{
+		ali_doc_info * doc;
+		ali_element_ref doc_root;
+		if (open)
+			doc_root = ali_open(&doc, file, ALI_OPTION_INPUT_XML_DECLARATION, NULL);
+		else
+			doc_root = ali_open_memory(&doc, xml.data(), (uint32_t)xml.size(), ALI_OPTION_INPUT_XML_DECLARATION, NULL);
+		if (readAliDocument(doc, doc_root) != (int)types)
+		{
+			printf("Error: the generated document did not read back.\n");
+			return 1;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	AllocStats after = AllocTracker::getTotal();
+	printf("Ali %s: %u types, depth %u, %u KB read %u times: %.1f MB/s, %llu allocations (%llu KB) per read, %llu KB peak.\n",
+		open ? "ali_open" : "ali_open_memory", types, depth, (uint)(xml.size() >> 10), runs, xml.size() * (double)runs / seconds / (1 << 20),
+		(unsigned long long)((after.count - before.count) / runs), (unsigned long long)((after.bytes - before.bytes) / runs >> 10),
+		(unsigned long long)((AllocTracker::getPeakLive() - before.live) >> 10));
+	return 0;
+}
+
+static void countAliEvent(ali_doc_info *, ali_text, void * data)
+{
+	(*(uint *)data)++;
+}
+
+// The input gets a block of exactly its size, so reading one byte past it is caught
+// by the sanitizer instead of landing in padding.
+static void fuzzAli(const char * data, uint size)
+{
+	char * input = new char[size];
+	memcpy(input, data, size);
+
+	ali_doc_info * doc;
+	ali_element_ref doc_root = ali_open_memory(&doc, input, size, ALI_OPTION_INPUT_XML_DECLARATION, NULL);
+	readAliDocument(doc, doc_root);
+
+	uint events = 0;
+	ali_handler handler = { countAliEvent, NULL, countAliEvent, countAliEvent };
+	ali_open_memory(&doc, input, size, ALI_OPTION_NONE, &events);
+	if (doc != NULL)
+	{
+		ali_parse(doc, &handler);
+		ali_close(doc);
+	}
+
+	ali_open_memory(&doc, input, size, ALI_OPTION_NONE, NULL);
+	if (doc != NULL)
+	{
+		ali_dom * dom = ali_dom_build(doc);
+		if (dom != NULL)
+		{
+			char tmp[256];
+			ali_text text;
+			for (ali_node_ref node = ali_dom_child(dom, ali_dom_root(dom), NULL); node != 0; node = ali_dom_next(dom, node, NULL))
+			{
+				ali_decode(doc, ali_dom_content(dom, node), tmp, sizeof(tmp));
+				if (ali_dom_attribute(dom, node, "name", &text))
+					ali_decode(doc, text, tmp, sizeof(tmp));
+			}
+			ali_dom_free(dom);
+		}
+		ali_close(doc);
+	}
+	delete[] input;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+	if (size <= 0xFFFFFFFF)
+		fuzzAli((const char *)data, (uint)size);
+	return 0;
+}
+
+#if !defined(ALI_LIBFUZZER)
+
+static int runAliFuzz(const char * file)
+{
+	std::vector<char> input;
+	FILE * f;
+	if (fopen_s(&f, file, "rb") != 0)
+	{
+		printf("Error: cannot read %s.\n", file);
+		return 1;
+	}
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		input.insert(input.end(), buffer, buffer + n);
+	fclose(f);
+	fuzzAli(input.data(), (uint)input.size());
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc > 2 && strcmp(argv[1], "--fuzz") == 0)
+		return runAliFuzz(argv[2]);
+	if (argc > 1 && strcmp(argv[1], "--bench-open") == 0)
+		return runAliBench(argc, argv, true);
+	if (argc > 1 && strcmp(argv[1], "--bench") != 0)
+	{
+		printf("Usage: AliBench --bench [types] [depth] [file]\n       AliBench --bench-open [types] [depth] [file]\n       AliBench --fuzz file\n");
+		return 1;
+	}
+	return runAliBench(argc, argv, false);
+}
+
+#endif
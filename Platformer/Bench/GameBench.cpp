@@ -0,0 +1,402 @@
+// Benchmarks and checks of the game code, kept out of the game's main. Builds from the game's
+// sources without main.cpp, plus this file and SFML.
+#include "../GameManager.h"
+#include "../GameObject.h"
+#include "../DrawableObject.h"
+#include "../Block.h"
+#include "../PlayerCharacter.h"
+#include "../AllocTracker.h"
+#include "../List.h"
+#include "../ListWithoutUID.h"
+#include <string.h>
+#include <vector>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+GameManager Mgr;
+sf::RenderWindow window;
+
+// --sprite-bench [sprites] [frames]: runs that many walking Jacks, all in view, for the frames at
+// 60 fps steps, once drawn in one call per texture and once a call per sprite, and prints the
+// average frame time (Update, Draw and display) and the draw calls of each.
+#define SPRITE_BENCH_SPRITES 10000
+#define SPRITE_BENCH_FRAMES 100
+#define SPRITE_BENCH_STEP 16667
+
+// --alloc-check [--lazy-animation]: runs the game's level at 60 fps steps and, after
+// ALLOC_CHECK_WARMUP frames, fails if any of the next ALLOC_CHECK_FRAMES Update()/Draw()
+// calls touches the heap. Needs TRACK_ALLOCATIONS.
+#define ALLOC_CHECK_WARMUP 120
+#define ALLOC_CHECK_FRAMES 600
+#define ALLOC_CHECK_STEP 16667
+
+// --leak-check [objects]: spawns and despawns that many objects through GameManager,
+// LEAK_CHECK_BATCH a frame, half Blocks from spawnMany() and half animated PlayerCharacters,
+// and fails if the live heap after the last frame is above what it was after
+// LEAK_CHECK_WARMUP frames, when pools, quads and playbacks have reached their size.
+// Needs TRACK_ALLOCATIONS.
+#define LEAK_CHECK_OBJECTS 2000000
+#define LEAK_CHECK_BATCH 10000
+#define LEAK_CHECK_WARMUP 3
+
+// --list-check [rounds]: each round builds and destroys LIST_CHECK_CHURN sets of List,
+// OwningList, ListWithoutUID and OwningListWithoutUID, and loads and deletes one
+// AnimationLoader. Fails like --leak-check if the live heap grew after LIST_CHECK_WARMUP rounds.
+// Needs TRACK_ALLOCATIONS.
+#define LIST_CHECK_ROUNDS 2000
+#define LIST_CHECK_CHURN 1000
+#define LIST_CHECK_ITEMS 8
+#define LIST_CHECK_WARMUP 3
+
+// --memory-report: builds the game's level and prints what a Block costs with the Renderer,
+// against the sf::Sprite it used to carry, and what the renderer holds for the level.
+
+// A Block as it was laid out while each object drew its own sf::Sprite, never built,
+// only measured so the memory report can show what the Renderer saves.
+struct SpriteBlockLayout : public GameObject
+{
+	Sprite sprite;
+	AnimatedObjectType * aotype;
+	AnimationState anim;
+	Vector2f drawnCoords;
+	unsigned char dirty;
+	Vector2f size;
+};
+
+// Resident memory of the process, which also sees what AllocTracker can't: SFML, the C
+// runtime and the allocator's own overhead. 0 where it isn't known.
+static uint64_t processResidentBytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	unsigned long long pages = 0, resident = 0;
+	FILE * f;
+	if (fopen_s(&f, "/proc/self/statm", "r") != 0)
+		return 0;
+	if (fscanf(f, "%llu %llu", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+// The level the game's main builds.
+static void spawnLevel()
+{
+	Mgr.getPool<Block>()->warmUp(100);
+	Mgr.getPool<PlayerCharacter>()->warmUp(4);
+
+	Vector2f coords[100];
+	for (int i = 0; i < 10; i++)
+		for (int j = 0; j < 10; j++)
+			coords[i * 10 + j] = Vector2f(j * 50, i * 50);
+	spawnMany<Block>(DrawableObject::makePrefab(TK_STATICBLOCK_GROUND, AK_IDLE_FIRST), coords, 100);
+
+	PlayerCharacter * pc = Mgr.spawn<PlayerCharacter>(Vector2f(100, 100), Vector2f(80, 96));
+	pc->playAnimation(AK_WALK_LEFT);
+	pc = Mgr.spawn<PlayerCharacter>(Vector2f(100, 300), Vector2f(80, 96));
+	pc->playAnimation(AK_WALK_RIGHT);
+	pc = Mgr.spawn<PlayerCharacter>(Vector2f(300, 300), Vector2f(80, 96));
+	pc->playAnimation(AK_WALK_LEFT);
+	pc = Mgr.spawn<PlayerCharacter>(Vector2f(300, 100), Vector2f(80, 96));
+	pc->playAnimation(AK_WALK_RIGHT);
+}
+
+static int runMemoryReport()
+{
+	window.create(VideoMode(500, 500), L"Block");
+	Mgr.initAnimationLoader(NULL);
+	spawnLevel();
+
+	uint sprite_bytes = sizeof(SpriteBlockLayout);
+	uint block_bytes = sizeof(Block) + 4 * sizeof(Vertex);
+	printf("Memory per Block: before %u bytes (sprite %u), after %u bytes (object %u, quad %u).\n",
+		sprite_bytes, (uint)sizeof(Sprite), block_bytes, (uint)sizeof(Block), (uint)(4 * sizeof(Vertex)));
+	printf("Memory for 1M tiles: before %u MB, after %u MB; renderer holds %u KB.\n",
+		(uint)((sprite_bytes * 1000000ull) >> 20), (uint)((block_bytes * 1000000ull) >> 20), (uint)(Mgr.getRenderer()->getMemoryUsage() >> 10));
+	window.close();
+	return 0;
+}
+
+static int runAllocCheck(int argc, char ** argv)
+{
+	if (!AllocTracker::isEnabled())
+	{
+		printf("Error: --alloc-check needs a build with TRACK_ALLOCATIONS.\n");
+		return 1;
+	}
+	bool lazy_animation = argc > 2 && strcmp(argv[2], "--lazy-animation") == 0;
+
+	window.create(VideoMode(500, 500), L"Block");
+	Mgr.initAnimationLoader(NULL);
+	Mgr.getAnimationLoader()->startWatching(); // as in the game, applyReload() runs in every Update()
+	Mgr.getAnimationSystem()->setLazy(lazy_animation);
+	spawnLevel();
+
+	for (uint frame = 0; frame < ALLOC_CHECK_WARMUP + ALLOC_CHECK_FRAMES; frame++)
+	{
+		bool checked = frame >= ALLOC_CHECK_WARMUP;
+		AllocTracker::beginFrame();
+		AllocTracker::setNoAllocs(checked);
+		Mgr.Update(ALLOC_CHECK_STEP);
+		window.clear();
+		Mgr.Draw();
+		AllocTracker::setNoAllocs(false);
+		if (checked && AllocTracker::getViolations() > 0)
+		{
+			printf("Error: frame %u allocated %llu times (%llu bytes), first in %s.\n", frame,
+				(unsigned long long)AllocTracker::getFrameAllocs(), (unsigned long long)AllocTracker::getFrameBytes(),
+				AllocTracker::getTagName(AllocTracker::getFirstViolation()));
+			window.close();
+			return 1;
+		}
+		window.display();
+		Mgr.getFrameArena()->reset();
+	}
+	printf("Allocation check passed: %u steady frames without heap allocations.\n", ALLOC_CHECK_FRAMES);
+	window.close();
+	return 0;
+}
+
+static int runLeakCheck(int argc, char ** argv)
+{
+	if (!AllocTracker::isEnabled())
+	{
+		printf("Error: --leak-check needs a build with TRACK_ALLOCATIONS.\n");
+		return 1;
+	}
+	uint objects = argc > 2 ? (uint)atoi(argv[2]) : LEAK_CHECK_OBJECTS;
+	uint frames = objects / LEAK_CHECK_BATCH;
+	if (frames <= LEAK_CHECK_WARMUP)
+	{
+		printf("Error: --leak-check needs more than %u objects.\n", LEAK_CHECK_BATCH * LEAK_CHECK_WARMUP);
+		return 1;
+	}
+
+	window.create(VideoMode(500, 500), L"Block");
+	Mgr.initAnimationLoader(NULL);
+	Prefab ground = DrawableObject::makePrefab(TK_STATICBLOCK_GROUND, AK_IDLE_FIRST);
+	std::vector<Vector2f> coords(LEAK_CHECK_BATCH / 2);
+	for (uint i = 0; i < coords.size(); i++)
+		coords[i] = Vector2f((float)(i % 500), (float)(i / 500 * 10));
+
+	uint64_t warm = 0, peak = 0, warm_rss = 0;
+	for (uint frame = 0; frame < frames; frame++)
+	{
+		if (!spawnMany<Block>(ground, &coords[0], (uint)coords.size()))
+		{
+			printf("Error: --leak-check needs StaticBlock/Ground in animations.data.\n");
+			return 1;
+		}
+		for (uint i = 0; i < LEAK_CHECK_BATCH / 2; i++)
+		{
+			PlayerCharacter * pc = Mgr.spawn<PlayerCharacter>(coords[i], Vector2f(80, 96));
+			pc->playAnimation(i % 2 ? AK_WALK_LEFT : AK_WALK_RIGHT, i % 3 != 0);
+		}
+		Mgr.Update(16667);
+		window.clear();
+		Mgr.Draw();
+		window.display();
+		Mgr.despawnAll();
+		Mgr.Update(16667); // the despawned objects go at the end of it
+		Mgr.getFrameArena()->reset();
+
+		uint64_t live = AllocTracker::getTotal().live;
+		if (frame + 1 == LEAK_CHECK_WARMUP)
+		{
+			warm = live;
+			warm_rss = processResidentBytes();
+		}
+		if (live > peak)
+			peak = live;
+	}
+	uint64_t live = AllocTracker::getTotal().live;
+	printf("Leak check: %u objects in %u frames, live heap %llu KB after warm-up, %llu KB at most, %llu KB at the end; resident %llu KB after warm-up, %llu KB at the end.\n",
+		frames * LEAK_CHECK_BATCH, frames, (unsigned long long)(warm >> 10), (unsigned long long)(peak >> 10), (unsigned long long)(live >> 10),
+		(unsigned long long)(warm_rss >> 10), (unsigned long long)(processResidentBytes() >> 10));
+	window.close();
+	if (live > warm)
+	{
+		printf("Error: the live heap grew by %llu bytes after warm-up.\n", (unsigned long long)(live - warm));
+		AllocTracker::printReport(); // which tag it is in
+		return 1;
+	}
+	printf("Leak check passed.\n");
+	return 0;
+}
+
+struct ListCheckItem
+{
+	uint uid;
+	ListCheckItem(uint uid) : uid(uid) {}
+	uint UID() { return uid; }
+};
+
+// One of each list, filled and taken apart through every way out of them.
+static void churnLists()
+{
+	ListCheckItem borrowed[LIST_CHECK_ITEMS] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+	OwningList<ListCheckItem> owning;
+	for (uint i = 1; i <= LIST_CHECK_ITEMS; i++)
+		owning.push(new ListCheckItem(i));
+	owning.removeObj(1);
+	delete owning.pinchObj(2);
+	delete owning.popObj();
+	OwningList<ListCheckItem> moved(std::move(owning));
+	owning = std::move(moved);
+
+	List<ListCheckItem> view;
+	for (uint i = 0; i < LIST_CHECK_ITEMS; i++)
+		view.push(&borrowed[i]);
+	view.removeElem(1);
+	view.pinchObj(2);
+	view.popObj();
+	List<ListCheckItem> viewMoved(std::move(view));
+
+	OwningListWithoutUID<ListCheckItem> owningWoUID;
+	for (uint i = 1; i <= LIST_CHECK_ITEMS; i++)
+		owningWoUID.push(new ListCheckItem(i));
+	delete owningWoUID.popObj();
+	OwningListWithoutUID<ListCheckItem> movedWoUID(std::move(owningWoUID));
+
+	ListWithoutUID<ListCheckItem> viewWoUID;
+	for (uint i = 0; i < LIST_CHECK_ITEMS; i++)
+		viewWoUID.push(&borrowed[i]);
+	viewWoUID.popObj();
+	viewWoUID.deform();
+	viewWoUID.push(&borrowed[0]);
+}
+
+static int runListCheck(int argc, char ** argv)
+{
+	if (!AllocTracker::isEnabled())
+	{
+		printf("Error: --list-check needs a build with TRACK_ALLOCATIONS.\n");
+		return 1;
+	}
+	uint rounds = argc > 2 ? (uint)atoi(argv[2]) : LIST_CHECK_ROUNDS;
+	if (rounds <= LIST_CHECK_WARMUP)
+	{
+		printf("Error: --list-check needs more than %u rounds.\n", LIST_CHECK_WARMUP);
+		return 1;
+	}
+
+	uint64_t warm = 0, peak = 0, warm_rss = 0;
+	for (uint round = 0; round < rounds; round++)
+	{
+		for (uint i = 0; i < LIST_CHECK_CHURN; i++)
+			churnLists();
+		AnimationLoader * loader = new AnimationLoader(NULL);
+		bool loaded = loader->isLoaded();
+		delete loader;
+		if (!loaded)
+		{
+			printf("Error: --list-check cannot load animations.data.\n");
+			return 1;
+		}
+
+		uint64_t live = AllocTracker::getTotal().live;
+		if (round + 1 == LIST_CHECK_WARMUP)
+		{
+			warm = live;
+			warm_rss = processResidentBytes();
+		}
+		if (live > peak)
+			peak = live;
+	}
+	uint64_t live = AllocTracker::getTotal().live;
+	printf("List check: %u lists and %u loaders, live heap %llu KB after warm-up, %llu KB at most, %llu KB at the end; resident %llu KB after warm-up, %llu KB at the end.\n",
+		rounds * LIST_CHECK_CHURN * 4, rounds, (unsigned long long)(warm >> 10), (unsigned long long)(peak >> 10), (unsigned long long)(live >> 10),
+		(unsigned long long)(warm_rss >> 10), (unsigned long long)(processResidentBytes() >> 10));
+	if (live > warm)
+	{
+		printf("Error: the live heap grew by %llu bytes after warm-up.\n", (unsigned long long)(live - warm));
+		AllocTracker::printReport();
+		return 1;
+	}
+	printf("List check passed.\n");
+	return 0;
+}
+
+// One pass of --sprite-bench, returns the average frame in microseconds.
+static double timeSpriteFrames(uint frames, uint * calls, uint * updates)
+{
+	Clock clock;
+	*updates = 0;
+	for (uint f = 0; f < frames; f++)
+	{
+		Mgr.Update(SPRITE_BENCH_STEP);
+		window.clear();
+		Mgr.Draw();
+		window.display();
+		Mgr.getFrameArena()->reset();
+		*updates += Mgr.getSpriteUpdates();
+	}
+	*calls = Mgr.getDrawCalls();
+	*updates /= frames;
+	return clock.getElapsedTime().asMicroseconds() / (double)frames;
+}
+
+static int runSpriteBench(int argc, char ** argv)
+{
+	uint sprites = argc > 2 ? (uint)atoi(argv[2]) : SPRITE_BENCH_SPRITES;
+	uint frames = argc > 3 ? (uint)atoi(argv[3]) : SPRITE_BENCH_FRAMES;
+	if (sprites == 0 || frames == 0)
+	{
+		printf("Error: --sprite-bench needs at least one sprite and one frame.\n");
+		return 1;
+	}
+
+	window.create(VideoMode(500, 500), L"Block");
+	Mgr.initAnimationLoader(NULL);
+	std::vector<Vector2f> coords(sprites);
+	for (uint i = 0; i < sprites; i++)
+		coords[i] = Vector2f((float)(i % 420), (float)(i / 420 % 400));
+	if (!spawnMany<Block>(DrawableObject::makePrefab(TK_CHARACTER_JACK, AK_WALK_LEFT), &coords[0], sprites))
+	{
+		printf("Error: --sprite-bench needs Character/Jack in animations.data.\n");
+		return 1;
+	}
+
+	uint calls, updates;
+	timeSpriteFrames(1, &calls, &updates); // every quad is written once on the first frame
+	double batched = timeSpriteFrames(frames, &calls, &updates);
+	printf("Sprites: %u animated, %u frames: batched %.2f ms per frame, %u draw call(s), %u sprites rebuilt per frame.\n",
+		sprites, frames, batched / 1000, calls, updates);
+	Mgr.getRenderer()->setBatching(false);
+	double single = timeSpriteFrames(frames, &calls, &updates);
+	printf("Sprites: %u animated, %u frames: per sprite %.2f ms per frame, %u draw call(s), %u sprites rebuilt per frame.\n",
+		sprites, frames, single / 1000, calls, updates);
+	window.close();
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "--sprite-bench") == 0)
+		return runSpriteBench(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--alloc-check") == 0)
+		return runAllocCheck(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--leak-check") == 0)
+		return runLeakCheck(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--list-check") == 0)
+		return runListCheck(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--memory-report") == 0)
+		return runMemoryReport();
+	printf("Usage: GameBench --sprite-bench [sprites] [frames]\n       GameBench --alloc-check [--lazy-animation]\n"
+		"       GameBench --leak-check [objects]\n       GameBench --list-check [rounds]\n       GameBench --memory-report\n");
+	return 1;
+}
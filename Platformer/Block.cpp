@@ -9,8 +9,8 @@ Block::Block() : DrawableObject()
 Block::Block(Vector2f _coords, Vector2f _size) : DrawableObject(_coords)
 {
 	size = _size;
-	initFromAOType(Mgr.getAnimationLoader()->getAOType("StaticBlock", "Ground"));
-	playAnimation("IDLE", "FIRST");
+	initFromAOType(Mgr.getAnimationLoader()->getAOType(TK_STATICBLOCK_GROUND));
+	playAnimation(AK_IDLE_FIRST);
 }
 
 
@@ -20,6 +20,12 @@ Block::~Block()
 {
 }
 
+void Block::spawn(const Prefab &p, Vector2f _coords, uint _quad)
+{
+	size = Vector2f(p.aotype->getSize());
+	DrawableObject::spawn(p, _coords, _quad);
+}
+
 void Block::Update(uint time_elapsed)
 {
 	;
@@ -34,5 +40,4 @@ void Block::SendMsg(Msg * msg)
 	default:
 		break;
 	}
-	delete msg;
 }
@@ -10,6 +10,8 @@ public:
 	Block(Vector2f _coords, Vector2f _size);
 	~Block();
 
+	void spawn(const Prefab &p, Vector2f _coords, uint _quad);
+
 	void Update(uint time_elapsed);
 	void SendMsg(Msg * msg);
 
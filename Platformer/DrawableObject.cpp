@@ -2,16 +2,35 @@
 
 DrawableObject::DrawableObject()
 {
+	aotype = NULL;
+	anim.clip = -1;
+	anim.slide = 0;
+	anim.slot = -1;
+	quad = RENDER_NO_QUAD;
+	instance = 0;
+	texture = RENDER_NO_TEXTURE;
+	flags = DRAW_REPEAT;
 }
 
 DrawableObject::DrawableObject(Vector2f _coords) : GameObject(_coords)
 {
+	aotype = NULL;
+	anim.clip = -1;
+	anim.slide = 0;
+	anim.slot = -1;
+	quad = RENDER_NO_QUAD;
+	instance = 0;
+	texture = RENDER_NO_TEXTURE;
+	flags = DRAW_REPEAT;
 }
 
 
 DrawableObject::~DrawableObject()
 {
-	animations.clear();
+	Mgr.getAnimationSystem()->stop(anim.slot);
+	Mgr.getRenderer()->removeQuad(texture, quad);
+	if (aotype != NULL)
+		aotype->removeInstance(instance);
 }
 
 void DrawableObject::initFromAOType(AnimatedObjectType * aot)
@@ -21,34 +40,98 @@ void DrawableObject::initFromAOType(AnimatedObjectType * aot)
 		printf("Houston, we have a problem...\n");
 		return;
 	}
-	Animation ** anims = NULL;
-	int animsN = aot->copyAnimations(&anims);
-	for (int i = 0; i < animsN; i++)
-	{
-		anims[i]->setOwner(this);
-		animations.push(anims[i]);
-	}
-	currentAnimation = anims[0];
-	delete[] anims;
+	aotype = aot;
+	anim.clip = aot->getAnimationCount() > 0 ? 0 : -1;
+	instance = aot->addInstance(this);
+	texture = Mgr.getRenderer()->addTexture(aot->getTexture());
+	quad = Mgr.getRenderer()->addQuad(texture);
+}
+
+Prefab DrawableObject::makePrefab(AnimatedObjectType * aot, uint animUID, bool repeat)
+{
+	Prefab p;
+	p.aotype = aot;
+	p.clip = aot ? aot->getAnimationIndex(animUID) : -1;
+	p.repeat = repeat;
+	p.texture = aot ? Mgr.getRenderer()->addTexture(aot->getTexture()) : RENDER_NO_TEXTURE;
+	return p;
+}
+
+Prefab DrawableObject::makePrefab(TypeKey type, AnimKey anim, bool repeat)
+{
+	AnimationLoader * loader = Mgr.getAnimationLoader();
+	return makePrefab(loader->getAOType(type), loader->getAnimationUID(anim), repeat);
+}
+
+// Bulk counterpart of the constructor, initFromAOType() and playAnimation(): nothing to look up.
+void DrawableObject::spawn(const Prefab &p, Vector2f _coords, uint _quad)
+{
+	coords = _coords;
+	uid = Mgr.getNewUID();
+	is_active = true;
+	aotype = p.aotype;
+	instance = aotype->addInstance(this);
+	texture = p.texture;
+	quad = _quad;
+	anim.clip = aotype->getAnimationCount() > 0 ? 0 : -1;
+	if (p.clip >= 0)
+		startClip(p.clip, p.repeat);
+}
+
+IntRect DrawableObject::getTextureRect()
+{
+	if (anim.clip < 0)
+		return IntRect();
+	return aotype->getAnimationAt(anim.clip)->getCoords()[anim.slide];
+}
+
+// The quad is only rewritten in Draw(), and only when something changed.
+void DrawableObject::updateQuad()
+{
+	if (anim.clip >= 0)
+		Mgr.getRenderer()->setQuad(texture, quad, coords, getTextureRect());
+	flags &= ~(DRAW_DIRTY_POSITION | DRAW_DIRTY_RECT);
+	Mgr.countSpriteUpdate();
+}
+
+// Called by AnimationLoader after the type's clip a changed on disk.
+void DrawableObject::reloadAnimation(Animation * a)
+{
+	if (anim.clip < 0 || aotype->getAnimationAt(anim.clip) != a)
+		return;
+	// restart even when inactive, the old slide may be past the new slide count
+	startClip(anim.clip, (flags & DRAW_REPEAT) != 0);
 }
 
-Sprite& DrawableObject::getSprite()
+void DrawableObject::playAnimationIndex(int clip, bool repeat)
 {
-	return sprite;
+	if (!is_active || aotype == NULL || clip < 0) return;
+	startClip(clip, repeat);
 }
 
-void DrawableObject::addAnimation(Animation * a)
+void DrawableObject::startClip(int clip, bool repeat)
 {
-	a->setOwner(this);
-	animations.push(a);
+	Animation * a = aotype->getAnimationAt(clip);
+	anim.clip = clip;
+	anim.slide = 0;
+	if (repeat)
+		flags |= DRAW_REPEAT;
+	else
+		flags &= ~DRAW_REPEAT;
+	if (a->getTimespan() > 0 && a->getSlides() > 1)
+		anim.slot = Mgr.getAnimationSystem()->play(this, a, repeat, anim.slot);
+	else if (anim.slot >= 0)
+	{
+		Mgr.getAnimationSystem()->stop(anim.slot);
+		anim.slot = -1;
+	}
+	flags |= DRAW_DIRTY_RECT;
 }
 
 void DrawableObject::playAnimation(uint uid, bool repeat)
 {
-	if (!is_active) return;
-	currentAnimation = animations.lookObj(uid);
-	repeatAnimation = repeat;
-	currentAnimation->startAnimation();
+	if (aotype == NULL) return;
+	playAnimationIndex(aotype->getAnimationIndex(uid), repeat);
 }
 
 void DrawableObject::playAnimation(char * type, char * subtype, bool repeat)
@@ -56,17 +139,59 @@ void DrawableObject::playAnimation(char * type, char * subtype, bool repeat)
 	playAnimation(Mgr.getAnimationLoader()->getAnimationUID(type, subtype), repeat);
 }
 
-void DrawableObject::updateAnimation(uint time_elapsed)
+void DrawableObject::playAnimation(AnimKey key, bool repeat)
 {
-	if (!is_active) return;
-	if (!repeatAnimation && currentAnimation->isFinished())
-		return;
-	currentAnimation->Update(time_elapsed);
+	playAnimation(Mgr.getAnimationLoader()->getAnimationUID(key), repeat);
+}
+
+bool DrawableObject::isVisible()
+{
+	const View &view = window.getView();
+	FloatRect visible(view.getCenter() - view.getSize() / 2.f, view.getSize());
+	IntRect r = getTextureRect();
+	return FloatRect(coords.x, coords.y, (float)r.width, (float)r.height).intersects(visible);
 }
 
+// Called by AnimationSystem when the playing clip moved to another slide.
+void DrawableObject::setSlide(int slide)
+{
+	anim.slide = slide;
+	flags |= DRAW_DIRTY_RECT;
+}
+
+void DrawableObject::setAnimationSlot(int slot)
+{
+	anim.slot = slot;
+}
+
+void DrawableObject::setInstanceIndex(uint index)
+{
+	instance = index;
+}
+
+// Brings the object's quad up to date; the Renderer draws all quads afterwards.
 void DrawableObject::Draw()
 {
-	if (!is_active) return;
-	sprite.setPosition(coords.x, coords.y);
-	window.draw(sprite);
-}
\ No newline at end of file
+	if (quad == RENDER_NO_QUAD) return;
+	if (!is_active || !isVisible())
+	{
+		if (flags & DRAW_VISIBLE)
+		{
+			Mgr.getRenderer()->hideQuad(texture, quad);
+			flags &= ~DRAW_VISIBLE;
+		}
+		return;
+	}
+	if (!(flags & DRAW_VISIBLE))
+		flags |= DRAW_VISIBLE | DRAW_DIRTY_POSITION | DRAW_DIRTY_RECT;
+	else if (coords != Mgr.getRenderer()->getQuad(texture, quad)[0].position)
+		flags |= DRAW_DIRTY_POSITION;
+	if (anim.slot >= 0 && Mgr.getAnimationSystem()->isLazy())
+	{
+		int slide = Mgr.getAnimationSystem()->slideAt(anim.slot);
+		if (slide != anim.slide)
+			setSlide(slide);
+	}
+	if (flags & (DRAW_DIRTY_POSITION | DRAW_DIRTY_RECT))
+		updateQuad();
+}
@@ -6,16 +6,39 @@ class DrawableObject;
 #include "List.h"
 #include "Animation.h"
 #include "AnimatedObjectType.h"
+#include "AnimationKeys.h"
 
 using namespace sf;
 
+// DrawableObject::flags
+#define DRAW_DIRTY_POSITION 1	// the quad is out of date with coords
+#define DRAW_DIRTY_RECT 2		// the quad is out of date with the slide
+#define DRAW_VISIBLE 4			// the quad is shown, not culled
+#define DRAW_REPEAT 8			// the animation loops
+
+// Everything needed to make objects of one look, resolved once for spawnMany().
+struct Prefab
+{
+	AnimatedObjectType * aotype;
+	int clip;					// clip to start with, -1 for none
+	bool repeat;
+	unsigned short texture;		// Renderer texture id of the type
+};
+
+// The quad that shows the object belongs to the Renderer; the object only keeps where it is.
 class DrawableObject : public GameObject
 {
 protected:
-	Sprite sprite;
-	List<Animation> animations;
-	Animation * currentAnimation;
-	bool repeatAnimation;
+	AnimatedObjectType * aotype;	// owns the animation clips
+	AnimationState anim;
+	uint quad;
+	uint instance;					// index in aotype's instances
+	unsigned short texture;
+	unsigned char flags;
+
+	void startClip(int clip, bool repeat);
+	bool isVisible();
+	void updateQuad();
 
 public:
 	DrawableObject();
@@ -23,13 +46,40 @@ public:
 	~DrawableObject();
 
 	void initFromAOType(AnimatedObjectType * aot);
+	void spawn(const Prefab &p, Vector2f _coords, uint _quad);
+	static Prefab makePrefab(AnimatedObjectType * aot, uint animUID, bool repeat = true);
+	static Prefab makePrefab(TypeKey type, AnimKey anim, bool repeat = true);
 
-	Sprite& getSprite();
+	IntRect getTextureRect();
 
-	void addAnimation(Animation * a);
+	void reloadAnimation(Animation * a);
+	void playAnimationIndex(int clip, bool repeat = true);
 	void playAnimation(uint uid, bool repeat = true);
 	void playAnimation(char * type, char * subtype, bool repeat = true);
-	void updateAnimation(uint time_elapsed);
+	void playAnimation(AnimKey key, bool repeat = true);
+	void setSlide(int slide);
+	void setAnimationSlot(int slot);
+	void setInstanceIndex(uint index);
 	void Draw();
 };
 
+// Makes n objects of p at positions from T's pool, warmed up to fit them in one go, with
+// their quads taken from the freed ones first. T needs a default constructor; T::spawn() may hide
+// DrawableObject::spawn() to set up its own fields. Returns false when p has no type.
+template<class T> bool spawnMany(const Prefab &p, const Vector2f * positions, uint n)
+{
+	if (p.aotype == NULL)
+		return false;
+	ObjectPool<T> * pool = Mgr.getPool<T>();
+	pool->warmUp(pool->getUsed() + n);
+	Mgr.getRenderer()->reserveQuads(p.texture, n);
+	p.aotype->reserveInstances(n);
+	Mgr.reserveObjects(n);
+	for (uint i = 0; i < n; i++)
+	{
+		T * o = pool->create();
+		o->spawn(p, positions[i], Mgr.getRenderer()->addQuad(p.texture));
+		Mgr.addNewObject(o);
+	}
+	return true;
+}
@@ -0,0 +1,95 @@
+#include "FrameArena.h"
+#include "AllocTracker.h"
+
+FrameArena::FrameArena(size_t chunkSize)
+{
+	this->chunkSize = chunkSize;
+	current = 0;
+	used = 0;
+	total = 0;
+	peak = 0;
+}
+
+FrameArena::~FrameArena()
+{
+	for (size_t i = 0; i < chunks.size(); i++)
+		delete[] chunks[i].data;
+}
+
+void * FrameArena::alloc(size_t size, size_t align)
+{
+	size_t pos = (used + align - 1) & ~(align - 1);
+	while (current < chunks.size() && pos + size > chunks[current].size)
+	{
+		// the rest of this chunk is wasted until reset()
+		current++;
+		used = 0;
+		pos = 0;
+	}
+	if (current == chunks.size())
+	{
+		AllocScope tag(ALLOC_ARENA);
+		Chunk c;
+		c.size = size > chunkSize ? size : chunkSize;
+		c.data = new char[c.size];
+		chunks.push_back(c);
+	}
+	used = pos + size;
+	total += size;
+	if (total > peak)
+		peak = total;
+	return chunks[current].data + pos;
+}
+
+FrameArena::Marker FrameArena::mark()
+{
+	Marker m = { current, used, total };
+	return m;
+}
+
+void FrameArena::release(Marker m)
+{
+	current = m.chunk;
+	used = m.used;
+	total = m.total;
+}
+
+// Starts over from the first chunk. When the frame spilled into more than one chunk they
+// are merged into a single one big enough for it, so the next frame bumps without checks.
+void FrameArena::reset()
+{
+	if (chunks.size() > 1)
+	{
+		AllocScope tag(ALLOC_ARENA);
+		size_t size = 0;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			size += chunks[i].size;
+			delete[] chunks[i].data;
+		}
+		chunks.resize(1);
+		chunks[0].size = size;
+		chunks[0].data = new char[size];
+	}
+	current = 0;
+	used = 0;
+	total = 0;
+}
+
+size_t FrameArena::getUsed()
+{
+	return total;
+}
+
+size_t FrameArena::getPeak()
+{
+	return peak;
+}
+
+size_t FrameArena::getCapacity()
+{
+	size_t size = 0;
+	for (size_t i = 0; i < chunks.size(); i++)
+		size += chunks[i].size;
+	return size;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+class FrameArena;
+
+#include <vector>
+#include <new>
+#include <utility>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+#define FRAME_ARENA_CHUNK (64 * 1024)
+
+// Bump allocator for data that lives at most until reset(). Allocating is a pointer bump,
+// nothing is ever freed on its own and no destructors run. The chunks are kept, so once
+// a frame's worth has been seen the arena stops touching the heap.
+// GameManager owns the one for the game thread, reset at the end of every main loop.
+class FrameArena
+{
+	struct Chunk
+	{
+		char * data;
+		size_t size;
+	};
+
+	std::vector<Chunk> chunks;
+	size_t current;		// chunk being filled
+	size_t used;		// bytes used in it
+	size_t chunkSize;
+	size_t total;		// bytes handed out since reset(), over all chunks
+	size_t peak;
+
+public:
+	struct Marker
+	{
+		size_t chunk;
+		size_t used;
+		size_t total;
+	};
+
+	FrameArena(size_t chunkSize = FRAME_ARENA_CHUNK);
+	~FrameArena();
+
+	void * alloc(size_t size, size_t align = sizeof(void *));
+	template<class T> T * allocArray(uint n);
+	template<class T> T * makeArray(uint n);
+	template<class T, class... Args> T * make(Args&&... args);
+
+	Marker mark();
+	void release(Marker m);
+	void reset();
+
+	size_t getUsed();
+	size_t getPeak();
+	size_t getCapacity();
+};
+
+// Uninitialized room for n T's.
+template<class T> T * FrameArena::allocArray(uint n)
+{
+	return (T *)alloc(sizeof(T) * n, __alignof(T));
+}
+
+// n default constructed T's, with the same caveat as make().
+template<class T> T * FrameArena::makeArray(uint n)
+{
+	T * a = allocArray<T>(n);
+	for (uint i = 0; i < n; i++)
+		new (a + i) T();
+	return a;
+}
+
+// Constructs a T in the arena. Its destructor never runs, so T must not own anything.
+template<class T, class... Args> T * FrameArena::make(Args&&... args)
+{
+	return new (alloc(sizeof(T), __alignof(T))) T(std::forward<Args>(args)...);
+}
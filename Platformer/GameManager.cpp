@@ -4,18 +4,30 @@ using namespace sf;
 
 void GameManager::SendToAll(Msg * m)
 {
-	for (GameObject * curr = objs.startLoopObj(); curr != NULL; curr = objs.nextStepObj())
-		curr->SendMsg(m);
+	for (size_t i = 0; i < objs.size(); i++)
+		objs[i]->SendMsg(m);
 }
 
 GameManager::GameManager()
 {
 	idCounter = 0;
+	animLoader = NULL;
+	spriteUpdates = 0;
+	drawCalls = 0;
+	despawned = 0;
 }
 
 
 GameManager::~GameManager()
 {
+	for (size_t i = 0; i < objs.size(); i++)
+		destroyObject(objs[i]);
+	objs.clear();
+	for (size_t i = 0; i < pools.size(); i++)
+		delete pools[i];
+	pools.clear();
+	// after the objects, they unregister from their types
+	delete animLoader;
 }
 
 void GameManager::initAnimationLoader(char * xmlfilename)
@@ -31,7 +43,60 @@ uint GameManager::getNewUID()
 
 void GameManager::addNewObject(GameObject * go)
 {
-	objs.push(go);
+	AllocScope tag(ALLOC_OBJECTS);
+	objs.push_back(go);
+}
+
+void GameManager::reserveObjects(uint n)
+{
+	AllocScope tag(ALLOC_OBJECTS);
+	objs.reserve(objs.size() + n);
+}
+
+// The object stays until the end of the frame's Update(), so loops over objs never see it vanish.
+void GameManager::despawn(GameObject * go)
+{
+	if (go->isDespawned())
+		return;
+	go->markDespawned();
+	despawned++;
+}
+
+void GameManager::despawnAll()
+{
+	for (size_t i = 0; i < objs.size(); i++)
+		despawn(objs[i]);
+}
+
+void GameManager::destroyObject(GameObject * go)
+{
+	if (go->getPool() != NULL)
+		go->getPool()->destroy(go);
+	else
+		delete go;
+}
+
+void GameManager::flushDespawned()
+{
+	if (despawned == 0)
+		return;
+	size_t kept = 0;
+	for (size_t i = 0; i < objs.size(); i++)
+	{
+		if (objs[i]->isDespawned())
+			destroyObject(objs[i]);
+		else
+			objs[kept++] = objs[i];
+	}
+	objs.resize(kept);
+	despawned = 0;
+}
+
+void GameManager::printPoolReport()
+{
+	for (size_t i = 0; i < pools.size(); i++)
+		if (pools[i] != NULL)
+			printf("Pool %s: %u used, %u at most, %u allocated.\n", pools[i]->getName(), pools[i]->getUsed(), pools[i]->getHighWater(), pools[i]->getCapacity());
 }
 
 AnimationLoader * GameManager::getAnimationLoader()
@@ -39,36 +104,81 @@ AnimationLoader * GameManager::getAnimationLoader()
 	return animLoader;
 }
 
+AnimationSystem * GameManager::getAnimationSystem()
+{
+	return &animSystem;
+}
+
+Renderer * GameManager::getRenderer()
+{
+	return &renderer;
+}
+
 void GameManager::Update(uint time_elapsed)
 {
 	//time_elapsed /= 1000;
-	for (GameObject * curr = objs.startLoopObj(); curr != NULL; curr = objs.nextStepObj())
-		curr->Update(time_elapsed);
+	animLoader->applyReload();
+	animSystem.update(time_elapsed);
+	animSystem.applyChanges();
+	for (size_t i = 0; i < objs.size(); i++)
+		if (!objs[i]->isDespawned())
+			objs[i]->Update(time_elapsed);
+	ReadMsgs();
+	flushDespawned();
+}
+
+FrameArena * GameManager::getFrameArena()
+{
+	return &frameArena;
 }
 
+// The message is copied, the sender keeps m.
 void GameManager::SendMsg(Msg *m)
 {
-	msgs.push(m);
+	msgs.push_back(*m);
 }
 
+// Messages sent by the handlers are read in another round, up to MSG_ROUNDS_PER_FRAME;
+// handlers that keep answering each other can't hang the frame, their messages carry over.
 void GameManager::ReadMsgs()
 {
-	Msg *m;
-	while(m = msgs.popObj())
+	for (uint round = 0; round < MSG_ROUNDS_PER_FRAME && !msgs.empty(); round++)
 	{
-		switch (m->type)
+		reading.swap(msgs);
+		for (size_t i = 0; i < reading.size(); i++)
 		{
-		case 1:
-			break;
-		default:
-			SendToAll(m);
+			Msg * m = &reading[i];
+			switch (m->type)
+			{
+			case 1:
+				break;
+			default:
+				SendToAll(m);
+			}
 		}
-		delete m;
+		reading.clear();
 	}
 }
 
 void GameManager::Draw()
 {
-	for (GameObject * curr = objs.startLoopObj(); curr != NULL; curr = objs.nextStepObj())
-		curr->Draw();
+	spriteUpdates = 0;
+	for (size_t i = 0; i < objs.size(); i++)
+		objs[i]->Draw();
+	drawCalls = renderer.draw(window);
+}
+
+void GameManager::countSpriteUpdate()
+{
+	spriteUpdates++;
+}
+
+uint GameManager::getSpriteUpdates()
+{
+	return spriteUpdates;
+}
+
+uint GameManager::getDrawCalls()
+{
+	return drawCalls;
 }
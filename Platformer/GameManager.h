@@ -5,9 +5,16 @@ class Msg;
 #include <SFML/Graphics.hpp>
 #include "GameObject.h"
 #include "List.h"
+#include <vector>
 #include "AnimationLoader.h"
+#include "AnimationSystem.h"
+#include "Renderer.h"
+#include "ObjectPool.h"
+#include "FrameArena.h"
+#include <typeinfo>
 
 #define NULL 0
+#define MSG_ROUNDS_PER_FRAME 8 // rounds of handler replies ReadMsgs() delivers, the rest waits for the next frame
 
 class Msg {
 public:
@@ -25,12 +32,23 @@ class GameManager
 {
 private:
 	uint idCounter;
-	List<GameObject> objs;
-	List<Msg> msgs;
+	std::vector<GameObject *> objs;
+	std::vector<Msg> msgs;	// copies, so the ones left for the next frame outlive the sender's
+	std::vector<Msg> reading;	// the round ReadMsgs() is delivering
+	std::vector<ObjectPoolBase *> pools; // index is poolTypeIndex<T>(), NULL until the type is first used
+	uint despawned; // marked this frame, removed by flushDespawned()
+	FrameArena frameArena;
+
+	void destroyObject(GameObject * go);
+	void flushDespawned();
 
 	void SendToAll(Msg *m);
 
 	AnimationLoader * animLoader;
+	AnimationSystem animSystem;
+	Renderer renderer;
+	uint spriteUpdates; // quads rebuilt during the last Draw()
+	uint drawCalls; // made by the last Draw()
 
 public:
 	GameManager();
@@ -40,12 +58,40 @@ public:
 
 	uint getNewUID();
 	void addNewObject(GameObject * go);
+	void reserveObjects(uint n);
+	void despawn(GameObject * go);
+	void despawnAll();
+	void printPoolReport();
+
+	// one pool per GameObject subclass, made on first use
+	template<class T> ObjectPool<T> * getPool()
+	{
+		uint index = poolTypeIndex<T>();
+		if (index >= pools.size())
+			pools.resize(index + 1, NULL);
+		if (pools[index] == NULL)
+			pools[index] = new ObjectPool<T>(typeid(T).name());
+		return static_cast<ObjectPool<T> *>(pools[index]);
+	}
+
+	template<class T, class... Args> T * spawn(Args&&... args)
+	{
+		T * o = getPool<T>()->create(std::forward<Args>(args)...);
+		addNewObject(o);
+		return o;
+	}
 	AnimationLoader * getAnimationLoader();
+	AnimationSystem * getAnimationSystem();
+	Renderer * getRenderer();
 
 	void Update(uint time_elapsed);
+	FrameArena * getFrameArena();
 	void SendMsg(Msg *m);
 	void ReadMsgs();
 	void Draw();
+	void countSpriteUpdate();
+	uint getSpriteUpdates();
+	uint getDrawCalls();
 
 };
 
@@ -4,7 +4,8 @@
 
 GameObject::GameObject()
 {
-
+	is_despawned = false;
+	pool = NULL;
 }
 
 GameObject::GameObject(Vector2f _coords, bool _is_active)
@@ -12,6 +13,8 @@ GameObject::GameObject(Vector2f _coords, bool _is_active)
 	coords = _coords;
 	uid = Mgr.getNewUID();
 	is_active = _is_active;
+	is_despawned = false;
+	pool = NULL;
 }
 
 GameObject::GameObject(Vector2f _coords, uint _uid, bool _is_active)
@@ -19,6 +22,8 @@ GameObject::GameObject(Vector2f _coords, uint _uid, bool _is_active)
 	coords = _coords;
 	uid = _uid;
 	is_active = _is_active;
+	is_despawned = false;
+	pool = NULL;
 }
 
 void GameObject::Coords(Vector2f c)
@@ -51,6 +56,25 @@ void GameObject::disActivate()
 	is_active = false;
 }
 
+void GameObject::setPool(ObjectPoolBase * p)
+{
+	pool = p;
+}
+
+ObjectPoolBase * GameObject::getPool()
+{
+	return pool;
+}
+
+void GameObject::markDespawned()
+{
+	is_despawned = true;
+}
+
+bool GameObject::isDespawned()
+{
+	return is_despawned;
+}
 
 GameObject::~GameObject()
 {
@@ -1,5 +1,6 @@
 #pragma once
 class GameObject;
+class ObjectPoolBase;
 
 #include "GameManager.h"
 
@@ -12,6 +13,8 @@ protected:
 	Vector2f coords;
 	uint uid;
 	bool is_active;
+	bool is_despawned;
+	ObjectPoolBase * pool; // NULL when made with new
 
 public:
 	GameObject();
@@ -26,10 +29,15 @@ public:
 	void activate();
 	void disActivate();
 
+	void setPool(ObjectPoolBase * p);
+	ObjectPoolBase * getPool();
+	void markDespawned();
+	bool isDespawned();
+
 	virtual void Update(uint time_elapsed) = 0;
 	virtual void SendMsg(Msg * msg) = 0;
 	virtual void Draw() = 0;
 
-	~GameObject();
+	virtual ~GameObject();
 };
 
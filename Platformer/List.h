@@ -1,6 +1,8 @@
 #pragma once
 #define NULL 0
 
+#include <utility>
+
 typedef unsigned int uint;
 
 template <class T> class Element
@@ -20,14 +22,22 @@ public:
 	void clear();
 };
 
+// Does not own its objects: destroying it, like deform(), frees the nodes only.
+// clear(), removeObj() and OwningList below delete the objects as well.
 template <class T> class List
 {
 	Element <T> * head;
 	Element <T> * tail;
 	Element <T> * pointer;
 	int listsize;
+
+	void unlink(Element<T> * e);
 public:
 	List();
+	List(List<T> &&other);
+	List<T> & operator=(List<T> &&other);
+	List(const List<T> &) = delete;
+	List<T> & operator=(const List<T> &) = delete;
 	~List();
 
 	void clear();
@@ -52,13 +62,31 @@ public:
 	Element<T> * lookElem(uint uid);
 	T * lookObj(uint uid);
 
-	T * startLoopElem();
-	T * nextStepElem();
+	Element<T> * startLoopElem();
+	Element<T> * nextStepElem();
 
 	T * startLoopObj();
 	T * nextStepObj();
 };
 
+// A List that owns its objects: they are deleted with the list.
+template <class T> class OwningList : public List<T>
+{
+public:
+	OwningList() {}
+	OwningList(OwningList<T> &&other) : List<T>(std::move(other)) {}
+	OwningList<T> & operator=(OwningList<T> &&other)
+	{
+		if (this != &other)
+		{
+			this->clear();
+			List<T>::operator=(std::move(other));
+		}
+		return *this;
+	}
+	~OwningList() { this->clear(); }
+};
+
 template<class T>
 T * Element<T>::getObj()
 {
@@ -68,7 +96,8 @@ T * Element<T>::getObj()
 template<class T>
 void Element<T>::clear()
 {
-	if (!obj) delete obj;
+	delete obj;
+	obj = NULL;
 }
 
 template<class T>
@@ -96,11 +125,53 @@ template<class T>
 List<T>::List()
 {
 	head = tail = pointer = NULL;
+	listsize = 0;
+}
+
+template<class T>
+List<T>::List(List<T> &&other)
+{
+	head = other.head;
+	tail = other.tail;
+	pointer = other.pointer;
+	listsize = other.listsize;
+	other.head = other.tail = other.pointer = NULL;
+	other.listsize = 0;
+}
+
+template<class T>
+List<T> & List<T>::operator=(List<T> &&other)
+{
+	if (this != &other)
+	{
+		deform();
+		head = other.head;
+		tail = other.tail;
+		pointer = other.pointer;
+		listsize = other.listsize;
+		other.head = other.tail = other.pointer = NULL;
+		other.listsize = 0;
+	}
+	return *this;
 }
 
 template<class T>
 List<T>::~List()
 {
+	deform();
+}
+
+// Takes e out of the chain, fixing head and tail; e itself is left alone.
+template<class T>
+void List<T>::unlink(Element<T> * e)
+{
+	if (e->prev) e->prev->next = e->next;
+	else head = e->next;
+	if (e->next) e->next->prev = e->prev;
+	else tail = e->prev;
+	if (pointer == e) pointer = NULL;
+	e->next = e->prev = NULL;
+	listsize--;
 }
 
 template<class T>
@@ -110,7 +181,7 @@ void List<T>::clear()
 	Element<T> *currNext;
 	while (curr)
 	{
-		currNext = head->next;
+		currNext = curr->next;
 		curr->clear();
 		delete curr;
 		curr = currNext;
@@ -118,6 +189,7 @@ void List<T>::clear()
 	listsize = 0;
 	head = NULL;
 	tail = NULL;
+	pointer = NULL;
 }
 
 template<class T>
@@ -127,13 +199,14 @@ void List<T>::deform()
 	Element<T> *currNext;
 	while (curr)
 	{
-		currNext = head->next;
+		currNext = curr->next;
 		delete curr;
 		curr = currNext;
 	}
 	listsize = 0;
 	head = NULL;
 	tail = NULL;
+	pointer = NULL;
 }
 
 template<class T>
@@ -180,6 +253,8 @@ Element<T>* List<T>::popElem()
 	head = head->next;
 	listsize--;
 	if (!head) tail = NULL;
+	else head->prev = NULL;
+	if (pointer == tmp) pointer = NULL;
 	return tmp;
 }
 
@@ -192,6 +267,8 @@ T * List<T>::popObj()
 	head = head->next;
 	listsize--;
 	if (!head) tail = NULL;
+	else head->prev = NULL;
+	if (pointer == tmp) pointer = NULL;
 	delete tmp;
 	return obj;
 }
@@ -215,17 +292,11 @@ bool List<T>::removeElem(uint uid)
 	if (uid == 0) return false;
 	if (!head) return false;
 	Element<T> *curr = head;
-	Element<T> *currNext;
-	Element<T> *currPrev;
-	while (curr->getObj()->UID() != uid && curr)
+	while (curr && curr->getObj()->UID() != uid)
 		curr = curr->next;
 	if (!curr) return false;
-	currPrev = curr->prev;
-	currNext = curr->next;
+	unlink(curr);
 	delete curr;
-	if (currPrev) currPrev->next = currNext;
-	if (currNext) currNext->prev = currPrev;
-	listsize--;
 	return true;
 }
 
@@ -235,18 +306,12 @@ bool List<T>::removeObj(uint uid)
 	if (uid == 0) return false;
 	if (!head) return false;
 	Element<T> *curr = head;
-	Element<T> *currNext;
-	Element<T> *currPrev;
-	while (curr->getObj()->UID() != uid && curr)
+	while (curr && curr->getObj()->UID() != uid)
 		curr = curr->next;
 	if (!curr) return false;
-	currPrev = curr->prev;
-	currNext = curr->next;
+	unlink(curr);
 	curr->clear();
 	delete curr;
-	if (currPrev) currPrev->next = currNext;
-	if (currNext) currNext->prev = currPrev;
-	listsize--;
 	return true;
 }
 
@@ -256,12 +321,10 @@ Element<T> * List<T>::pinchElem(uint uid)
 	if (uid == 0) return NULL;
 	if (!head) return NULL;
 	Element<T> *curr = head;
-	while (curr->getObj()->UID() != uid && curr)
+	while (curr && curr->getObj()->UID() != uid)
 		curr = curr->next;
 	if (!curr) return NULL;
-	if (curr->prev) curr->prev->next = curr->next;
-	if (curr->next) curr->next->prev = curr->prev;
-	listsize--;
+	unlink(curr);
 	return curr;
 }
 
@@ -271,12 +334,10 @@ T * List<T>::pinchObj(uint uid)
 	if (uid == 0) return NULL;
 	if (!head) return NULL;
 	Element<T> *curr = head;
-	while (curr->getObj()->UID() != uid && curr)
+	while (curr && curr->getObj()->UID() != uid)
 		curr = curr->next;
 	if (!curr) return NULL;
-	if (curr->prev) curr->prev->next = curr->next;
-	if (curr->next) curr->next->prev = curr->prev;
-	listsize--;
+	unlink(curr);
 	T * obj = curr->getObj();
 	delete curr;
 	return obj;
@@ -288,7 +349,7 @@ Element<T>* List<T>::lookElem(uint uid)
 	if (uid == 0) return NULL;
 	if (!head) return NULL;
 	Element<T> *curr = head;
-	while (curr->getObj()->UID() != uid && curr)
+	while (curr && curr->getObj()->UID() != uid)
 		curr = curr->next;
 	return curr;
 }
@@ -299,20 +360,20 @@ T * List<T>::lookObj(uint uid)
 	if (uid == 0) return NULL;
 	if (!head) return NULL;
 	Element<T> *curr = head;
-	while (curr->getObj()->UID() != uid && curr)
+	while (curr && curr->getObj()->UID() != uid)
 		curr = curr->next;
 	if (!curr) return NULL;
 	return curr->getObj();
 }
 
 template<class T>
-T * List<T>::startLoopElem()
+Element<T> * List<T>::startLoopElem()
 {
 	return pointer = head;
 }
 
 template<class T>
-T * List<T>::nextStepElem()
+Element<T> * List<T>::nextStepElem()
 {
 	if (!pointer) return NULL;
 	return pointer = pointer->next;
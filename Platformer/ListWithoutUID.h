@@ -1,8 +1,8 @@
-#pragma once
-
 #pragma once
 #define NULL 0
 
+#include <utility>
+
 template <class T> class ElementWoUID
 {
 private:
@@ -20,6 +20,8 @@ public:
 	void clear();
 };
 
+// Does not own its objects: destroying it, like deform(), frees the nodes only.
+// clear() and OwningListWithoutUID below delete the objects as well.
 template <class T> class ListWithoutUID
 {
 	ElementWoUID <T> * head;
@@ -28,6 +30,10 @@ template <class T> class ListWithoutUID
 	int listsize;
 public:
 	ListWithoutUID();
+	ListWithoutUID(ListWithoutUID<T> &&other);
+	ListWithoutUID<T> & operator=(ListWithoutUID<T> &&other);
+	ListWithoutUID(const ListWithoutUID<T> &) = delete;
+	ListWithoutUID<T> & operator=(const ListWithoutUID<T> &) = delete;
 	~ListWithoutUID();
 
 	void clear();
@@ -43,13 +49,31 @@ public:
 	ElementWoUID<T> * lookFirstElem();
 	T * lookFirstObj();
 
-	T * startLoopElem();
-	T * nextStepElem();
+	ElementWoUID<T> * startLoopElem();
+	ElementWoUID<T> * nextStepElem();
 
 	T * startLoopObj();
 	T * nextStepObj();
 };
 
+// A ListWithoutUID that owns its objects: they are deleted with the list.
+template <class T> class OwningListWithoutUID : public ListWithoutUID<T>
+{
+public:
+	OwningListWithoutUID() {}
+	OwningListWithoutUID(OwningListWithoutUID<T> &&other) : ListWithoutUID<T>(std::move(other)) {}
+	OwningListWithoutUID<T> & operator=(OwningListWithoutUID<T> &&other)
+	{
+		if (this != &other)
+		{
+			this->clear();
+			ListWithoutUID<T>::operator=(std::move(other));
+		}
+		return *this;
+	}
+	~OwningListWithoutUID() { this->clear(); }
+};
+
 template<class T>
 T * ElementWoUID<T>::getObj()
 {
@@ -59,7 +83,8 @@ T * ElementWoUID<T>::getObj()
 template<class T>
 void ElementWoUID<T>::clear()
 {
-	if (!obj) delete obj;
+	delete obj;
+	obj = NULL;
 }
 
 template<class T>
@@ -87,11 +112,40 @@ template<class T>
 ListWithoutUID<T>::ListWithoutUID()
 {
 	head = tail = pointer = NULL;
+	listsize = 0;
+}
+
+template<class T>
+ListWithoutUID<T>::ListWithoutUID(ListWithoutUID<T> &&other)
+{
+	head = other.head;
+	tail = other.tail;
+	pointer = other.pointer;
+	listsize = other.listsize;
+	other.head = other.tail = other.pointer = NULL;
+	other.listsize = 0;
+}
+
+template<class T>
+ListWithoutUID<T> & ListWithoutUID<T>::operator=(ListWithoutUID<T> &&other)
+{
+	if (this != &other)
+	{
+		deform();
+		head = other.head;
+		tail = other.tail;
+		pointer = other.pointer;
+		listsize = other.listsize;
+		other.head = other.tail = other.pointer = NULL;
+		other.listsize = 0;
+	}
+	return *this;
 }
 
 template<class T>
 ListWithoutUID<T>::~ListWithoutUID()
 {
+	deform();
 }
 
 template<class T>
@@ -101,7 +155,7 @@ void ListWithoutUID<T>::clear()
 	ElementWoUID<T> *currNext;
 	while (curr)
 	{
-		currNext = head->next;
+		currNext = curr->next;
 		curr->clear();
 		delete curr;
 		curr = currNext;
@@ -109,6 +163,7 @@ void ListWithoutUID<T>::clear()
 	listsize = 0;
 	head = NULL;
 	tail = NULL;
+	pointer = NULL;
 }
 
 template<class T>
@@ -118,13 +173,14 @@ void ListWithoutUID<T>::deform()
 	ElementWoUID<T> *currNext;
 	while (curr)
 	{
-		currNext = head->next;
+		currNext = curr->next;
 		delete curr;
 		curr = currNext;
 	}
 	listsize = 0;
 	head = NULL;
 	tail = NULL;
+	pointer = NULL;
 }
 
 template<class T>
@@ -171,6 +227,8 @@ ElementWoUID<T>* ListWithoutUID<T>::popElem()
 	head = head->next;
 	listsize--;
 	if (!head) tail = NULL;
+	else head->prev = NULL;
+	if (pointer == tmp) pointer = NULL;
 	return tmp;
 }
 
@@ -183,6 +241,8 @@ T * ListWithoutUID<T>::popObj()
 	head = head->next;
 	listsize--;
 	if (!head) tail = NULL;
+	else head->prev = NULL;
+	if (pointer == tmp) pointer = NULL;
 	delete tmp;
 	return obj;
 }
@@ -201,13 +261,13 @@ T * ListWithoutUID<T>::lookFirstObj()
 }
 
 template<class T>
-T * ListWithoutUID<T>::startLoopElem()
+ElementWoUID<T> * ListWithoutUID<T>::startLoopElem()
 {
 	return pointer = head;
 }
 
 template<class T>
-T * ListWithoutUID<T>::nextStepElem()
+ElementWoUID<T> * ListWithoutUID<T>::nextStepElem()
 {
 	if (!pointer) return NULL;
 	return pointer = pointer->next;
@@ -0,0 +1,27 @@
+#pragma once
+
+class MappedFile;
+
+typedef unsigned int uint;
+
+// Read-only view of a whole file mapped into memory. The data stays valid until close().
+class MappedFile
+{
+	const char * data;
+	uint size;
+#if defined(_WIN32)
+	void * file;
+	void * mapping;
+#else
+	int fd;
+#endif
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char * filename);
+	void close();
+
+	const char * getData();
+	uint getSize();
+};
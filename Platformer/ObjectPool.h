@@ -0,0 +1,149 @@
+#pragma once
+class GameObject;
+
+#include <new>
+#include <utility>
+#include <vector>
+#include <atomic>
+#include "AllocTracker.h"
+
+typedef unsigned int uint;
+
+#define POOL_SLAB_SIZE 256
+
+// A small index per pooled type, the same for every GameManager, which keeps its pools in
+// a table under it. Only the index is shared, each manager owns its own pools.
+inline uint newPoolTypeIndex()
+{
+	static std::atomic<uint> count(0);
+	return count++;
+}
+
+template <class T> uint poolTypeIndex()
+{
+	static const uint index = newPoolTypeIndex();
+	return index;
+}
+
+// What GameManager needs to know about a pool without knowing its type.
+class ObjectPoolBase
+{
+protected:
+	const char * name;
+	uint used;
+	uint highWater;
+	uint capacity;
+public:
+	ObjectPoolBase(const char * name);
+	virtual ~ObjectPoolBase();
+
+	virtual void destroy(GameObject * o) = 0;
+
+	const char * getName();
+	uint getUsed();
+	uint getHighWater();
+	uint getCapacity();
+};
+
+// Typed pool: objects of T are constructed in place in slabs of raw storage and go back
+// to a free list when destroyed, so same-type objects stay next to each other and churn
+// never reaches the global allocator once the pool is warm.
+template <class T> class ObjectPool : public ObjectPoolBase
+{
+	uint slabSize;
+	std::vector<T *> slabs;
+	std::vector<T *> freeList; // last out first
+
+	void addSlab(uint n);
+public:
+	ObjectPool(const char * name, uint slabSize = POOL_SLAB_SIZE);
+	~ObjectPool();
+
+	void warmUp(uint n);
+	template <class... Args> T * create(Args&&... args);
+	void destroy(GameObject * o);
+};
+
+inline ObjectPoolBase::ObjectPoolBase(const char * name)
+{
+	this->name = name;
+	used = 0;
+	highWater = 0;
+	capacity = 0;
+}
+
+inline ObjectPoolBase::~ObjectPoolBase()
+{
+}
+
+inline const char * ObjectPoolBase::getName()
+{
+	return name;
+}
+
+inline uint ObjectPoolBase::getUsed()
+{
+	return used;
+}
+
+inline uint ObjectPoolBase::getHighWater()
+{
+	return highWater;
+}
+
+inline uint ObjectPoolBase::getCapacity()
+{
+	return capacity;
+}
+
+template <class T> ObjectPool<T>::ObjectPool(const char * name, uint slabSize) : ObjectPoolBase(name)
+{
+	this->slabSize = slabSize;
+}
+
+// Only frees the storage, the objects must have been destroyed by then.
+template <class T> ObjectPool<T>::~ObjectPool()
+{
+	for (size_t i = 0; i < slabs.size(); i++)
+		::operator delete(slabs[i]);
+}
+
+template <class T> void ObjectPool<T>::addSlab(uint n)
+{
+	AllocScope tag(ALLOC_OBJECTS);
+	T * slab = (T *)::operator new(sizeof(T) * n);
+	slabs.push_back(slab);
+	freeList.reserve(freeList.size() + n);
+	// backwards, so objects are handed out in address order
+	for (uint i = n; i > 0; i--)
+		freeList.push_back(slab + i - 1);
+	capacity += n;
+}
+
+// Makes room for n live objects in one slab, so a level load allocates once.
+template <class T> void ObjectPool<T>::warmUp(uint n)
+{
+	if (n > capacity)
+		addSlab(n - capacity);
+}
+
+template <class T> template <class... Args> T * ObjectPool<T>::create(Args&&... args)
+{
+	if (freeList.empty())
+		addSlab(slabSize);
+	T * o = freeList.back();
+	freeList.pop_back();
+	new (o) T(std::forward<Args>(args)...);
+	o->setPool(this);
+	if (++used > highWater)
+		highWater = used;
+	return o;
+}
+
+template <class T> void ObjectPool<T>::destroy(GameObject * o)
+{
+	T * t = static_cast<T *>(o);
+	t->~T();
+	freeList.push_back(t);
+	used--;
+}
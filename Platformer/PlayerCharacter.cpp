@@ -4,7 +4,7 @@
 PlayerCharacter::PlayerCharacter(Vector2f _coords, Vector2f _size) : DrawableObject(_coords)
 {
 	size = _size;
-	initFromAOType(Mgr.getAnimationLoader()->getAOType("Character", "Jack"));
+	initFromAOType(Mgr.getAnimationLoader()->getAOType(TK_CHARACTER_JACK));
 }
 
 PlayerCharacter::~PlayerCharacter()
@@ -13,7 +13,7 @@ PlayerCharacter::~PlayerCharacter()
 
 void PlayerCharacter::Update(uint time_elapsed)
 {
-	currentAnimation->Update(time_elapsed);
+	;
 }
 
 void PlayerCharacter::SendMsg(Msg * msg)
@@ -1,8 +1,9 @@
 #include"RegistratedString.h"
 
-RegistratedString::RegistratedString(char * str, uint uid)
+RegistratedString::RegistratedString(const char * str, uint uid)
 {
-	strcpy_s(this->str, str);
+	strid = Strings.intern(str);
+	hash = StringInterner::hash(str);
 	this->uid = uid;
 }
 
@@ -11,31 +12,135 @@ uint RegistratedString::UID()
 	return uid;
 }
 
+uint RegistratedString::strID()
+{
+	return strid;
+}
+
+uint RegistratedString::getHash()
+{
+	return hash;
+}
+
+const char * RegistratedString::getStr()
+{
+	return Strings.getStr(strid);
+}
+
 void RegistratedString::getStr(char * str)
 {
-	strcpy_s(str, 256, this->str);
+	strcpy_s(str, 256, Strings.getStr(strid));
 }
 
-uint RegistratedString::getUIDbyName(List<RegistratedString>* list, char * name)
+RegistratedStringTable::RegistratedStringTable()
 {
-	char str[256];
-	for (RegistratedString * rs = list->startLoopObj(); rs != NULL; rs = list->nextStepObj())
+	hashCount = 0;
+}
+
+RegistratedStringTable::~RegistratedStringTable()
+{
+	clear();
+}
+
+RegistratedString * RegistratedStringTable::add(const char * name)
+{
+	RegistratedString * rs = new RegistratedString(name, (uint)byUID.size() + 1);
+	byUID.push_back(rs);
+	if (byStr.size() <= rs->strID())
+		byStr.resize(rs->strID() + 1, NULL);
+	if (byStr[rs->strID()] == NULL)
 	{
-		rs->getStr(str);
-		if (strcmp(name, str) == 0)
-			return rs->uid;
+		byStr[rs->strID()] = rs;
+		insertHash(rs);
 	}
-	return 0;
+	return rs;
 }
 
-RegistratedString * RegistratedString::getRSbyName(List<RegistratedString>* list, char * name)
+void RegistratedStringTable::insertHash(RegistratedString * rs)
 {
-	char str[256];
-	for (RegistratedString * rs = list->startLoopObj(); rs != NULL; rs = list->nextStepObj())
+	// keep the load factor under one half
+	if ((hashCount + 1) * 2 > byHash.size())
+	{
+		std::vector<RegistratedString *> old;
+		old.swap(byHash);
+		byHash.resize(old.empty() ? 16 : old.size() * 2, NULL);
+		hashCount = 0;
+		for (size_t i = 0; i < old.size(); i++)
+			if (old[i])
+				insertHash(old[i]);
+	}
+	uint mask = (uint)byHash.size() - 1;
+	uint i = rs->getHash() & mask;
+	while (byHash[i] != NULL)
 	{
-		rs->getStr(str);
-		if (strcmp(name, str) == 0)
-			return rs;
+		if (byHash[i]->getHash() == rs->getHash())
+		{
+			printf("Error: names %s and %s have the same hash, keys for %s will not resolve.\n", byHash[i]->getStr(), rs->getStr(), rs->getStr());
+			return;
+		}
+		i = (i + 1) & mask;
 	}
+	byHash[i] = rs;
+	hashCount++;
+}
+
+RegistratedString * RegistratedStringTable::registerName(const char * name)
+{
+	RegistratedString * rs = get(name);
+	if (rs == NULL)
+		rs = add(name);
+	return rs;
+}
+
+RegistratedString * RegistratedStringTable::get(const char * name)
+{
+	uint id = Strings.find(name);
+	if (id == 0 || id >= byStr.size())
+		return NULL;
+	return byStr[id];
+}
+
+RegistratedString * RegistratedStringTable::get(uint uid)
+{
+	if (uid == 0 || uid > byUID.size())
+		return NULL;
+	return byUID[uid - 1];
+}
+
+RegistratedString * RegistratedStringTable::getByHash(uint hash)
+{
+	if (byHash.empty())
+		return NULL;
+	uint mask = (uint)byHash.size() - 1;
+	for (uint i = hash & mask; byHash[i] != NULL; i = (i + 1) & mask)
+		if (byHash[i]->getHash() == hash)
+			return byHash[i];
 	return NULL;
 }
+
+uint RegistratedStringTable::getUIDByHash(uint hash)
+{
+	RegistratedString * rs = getByHash(hash);
+	return rs ? rs->UID() : 0;
+}
+
+uint RegistratedStringTable::getUID(const char * name)
+{
+	RegistratedString * rs = get(name);
+	return rs ? rs->UID() : 0;
+}
+
+uint RegistratedStringTable::getSize()
+{
+	return (uint)byUID.size();
+}
+
+void RegistratedStringTable::clear()
+{
+	for (size_t i = 0; i < byUID.size(); i++)
+		delete byUID[i];
+	byUID.clear();
+	byStr.clear();
+	byHash.clear();
+	hashCount = 0;
+}
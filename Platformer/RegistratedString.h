@@ -1,19 +1,49 @@
 #pragma once
 #include<iostream>
-#include"List.h"
+#include<vector>
+#include"StringInterner.h"
 
 typedef unsigned int uint;
 
+// A name registered in one of the loader's categories. The text lives in the global
+// StringInterner, so only its id is kept here.
 class RegistratedString
 {
 private:
-	char str[256];
+	uint strid;
+	uint hash;
 	uint uid;
 	RegistratedString();
 public:
-	RegistratedString(char * str, uint uid);
+	RegistratedString(const char * str, uint uid);
 	uint UID();
+	uint strID();
+	uint getHash();
+	const char * getStr();
 	void getStr(char * str);
-	static uint getUIDbyName(List<RegistratedString> * list, char * name);
-	static RegistratedString * getRSbyName(List<RegistratedString> * list, char * name);
-};
\ No newline at end of file
+};
+
+// One category of registered names (class names, type names, animation types...).
+// Uids are handed out densely from 1; both uid and name lookups are O(1).
+class RegistratedStringTable
+{
+	std::vector<RegistratedString *> byUID;	// uid - 1
+	std::vector<RegistratedString *> byStr;	// interned id, first registration wins
+	std::vector<RegistratedString *> byHash;	// open addressing on the name hash
+	uint hashCount;
+
+	void insertHash(RegistratedString * rs);
+public:
+	RegistratedStringTable();
+	~RegistratedStringTable();
+
+	RegistratedString * add(const char * name);
+	RegistratedString * registerName(const char * name);
+	RegistratedString * get(const char * name);
+	RegistratedString * get(uint uid);
+	RegistratedString * getByHash(uint hash);
+	uint getUID(const char * name);
+	uint getUIDByHash(uint hash);
+	uint getSize();
+	void clear();
+};
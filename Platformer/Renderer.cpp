@@ -0,0 +1,133 @@
+#include "Renderer.h"
+#include "AllocTracker.h"
+
+Renderer::Renderer()
+{
+	batching = true;
+}
+
+Renderer::~Renderer()
+{
+}
+
+unsigned short Renderer::addTexture(Texture * texture)
+{
+	AllocScope tag(ALLOC_RENDER);
+	for (size_t i = 0; i < batches.size(); i++)
+		if (batches[i].texture == texture)
+			return (unsigned short)i;
+	batches.push_back(Batch());
+	batches.back().texture = texture;
+	return (unsigned short)(batches.size() - 1);
+}
+
+uint Renderer::addQuad(unsigned short texture)
+{
+	AllocScope tag(ALLOC_RENDER);
+	Batch &b = batches[texture];
+	uint quad;
+	if (!b.freeQuads.empty())
+	{
+		quad = b.freeQuads.back();
+		b.freeQuads.pop_back();
+	}
+	else
+	{
+		quad = (uint)(b.vertices.size() / 4);
+		b.vertices.resize(b.vertices.size() + 4);
+	}
+	return quad;
+}
+
+// Makes room so the next n addQuad() calls, after the free quads are used up, do not reallocate.
+void Renderer::reserveQuads(unsigned short texture, uint n)
+{
+	AllocScope tag(ALLOC_RENDER);
+	Batch &b = batches[texture];
+	if (n > b.freeQuads.size())
+		b.vertices.reserve(b.vertices.size() + 4 * (n - b.freeQuads.size()));
+}
+
+void Renderer::removeQuad(unsigned short texture, uint quad)
+{
+	if (texture == RENDER_NO_TEXTURE || quad == RENDER_NO_QUAD)
+		return;
+	AllocScope tag(ALLOC_RENDER);
+	hideQuad(texture, quad);
+	batches[texture].freeQuads.push_back(quad);
+}
+
+void Renderer::setQuad(unsigned short texture, uint quad, Vector2f position, const IntRect &rect)
+{
+	Vertex * v = &batches[texture].vertices[quad * 4];
+	float w = (float)rect.width, h = (float)rect.height;
+	float l = (float)rect.left, t = (float)rect.top;
+	v[0].position = position;
+	v[1].position = Vector2f(position.x + w, position.y);
+	v[2].position = Vector2f(position.x + w, position.y + h);
+	v[3].position = Vector2f(position.x, position.y + h);
+	v[0].texCoords = Vector2f(l, t);
+	v[1].texCoords = Vector2f(l + w, t);
+	v[2].texCoords = Vector2f(l + w, t + h);
+	v[3].texCoords = Vector2f(l, t + h);
+}
+
+// Collapses the quad onto its first corner, so nothing is rasterized.
+void Renderer::hideQuad(unsigned short texture, uint quad)
+{
+	Vertex * v = &batches[texture].vertices[quad * 4];
+	v[1].position = v[2].position = v[3].position = v[0].position;
+}
+
+const Vertex * Renderer::getQuad(unsigned short texture, uint quad)
+{
+	return &batches[texture].vertices[quad * 4];
+}
+
+// Returns the number of draw calls.
+uint Renderer::draw(RenderWindow &target)
+{
+	AllocScope tag(ALLOC_RENDER);
+	uint calls = 0;
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		if (batches[i].vertices.empty())
+			continue;
+		if (batching)
+		{
+			target.draw(&batches[i].vertices[0], batches[i].vertices.size(), Quads, RenderStates(batches[i].texture));
+			calls++;
+			continue;
+		}
+		for (size_t v = 0; v < batches[i].vertices.size(); v += 4)
+		{
+			// hidden and free quads are collapsed, a sprite would not have been drawn
+			if (batches[i].vertices[v].position == batches[i].vertices[v + 2].position)
+				continue;
+			target.draw(&batches[i].vertices[v], 4, Quads, RenderStates(batches[i].texture));
+			calls++;
+		}
+	}
+	return calls;
+}
+
+void Renderer::setBatching(bool on)
+{
+	batching = on;
+}
+
+uint Renderer::getQuadCount()
+{
+	uint n = 0;
+	for (size_t i = 0; i < batches.size(); i++)
+		n += (uint)(batches[i].vertices.size() / 4 - batches[i].freeQuads.size());
+	return n;
+}
+
+size_t Renderer::getMemoryUsage()
+{
+	size_t bytes = sizeof(Renderer) + batches.capacity() * sizeof(Batch);
+	for (size_t i = 0; i < batches.size(); i++)
+		bytes += batches[i].vertices.capacity() * sizeof(Vertex) + batches[i].freeQuads.capacity() * sizeof(uint);
+	return bytes;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+class Renderer;
+
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+using namespace sf;
+
+typedef unsigned int uint;
+
+#define RENDER_NO_QUAD 0xffffffff
+#define RENDER_NO_TEXTURE 0xffff
+
+// Owns the vertices of every drawable. Objects only keep a texture id and a quad index;
+// their quads live in one vertex array per texture, which is drawn with a single call.
+// Hidden and freed quads stay in place with zero size.
+class Renderer
+{
+	struct Batch
+	{
+		Texture * texture;
+		std::vector<Vertex> vertices;	// 4 per quad
+		std::vector<uint> freeQuads;
+	};
+
+	std::vector<Batch> batches; // index is the texture id
+	bool batching; // off draws a call per quad, the way sprites were drawn; for --sprite-bench
+
+public:
+	Renderer();
+	~Renderer();
+
+	unsigned short addTexture(Texture * texture);
+	uint addQuad(unsigned short texture);
+	void reserveQuads(unsigned short texture, uint n);
+	void removeQuad(unsigned short texture, uint quad);
+	void setQuad(unsigned short texture, uint quad, Vector2f position, const IntRect &rect);
+	void hideQuad(unsigned short texture, uint quad);
+	const Vertex * getQuad(unsigned short texture, uint quad);
+
+	uint draw(RenderWindow &target);
+	void setBatching(bool on);
+
+	uint getQuadCount();
+	size_t getMemoryUsage();
+};
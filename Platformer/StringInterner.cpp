@@ -0,0 +1,160 @@
+#include "StringInterner.h"
+#include <stdio.h>
+#include <string.h>
+
+StringInterner Strings;
+
+StringInterner::StringInterner()
+{
+	for (uint i = 0; i < STRING_CHUNKS; i++)
+		chunks[i] = NULL;
+	count = 0;
+	table = makeTable(63);
+	blockPos = NULL;
+	blockLeft = 0;
+}
+
+StringInterner::~StringInterner()
+{
+	oldTables.push_back(table);
+	for (size_t i = 0; i < oldTables.size(); i++)
+	{
+		delete[] oldTables[i]->slots;
+		delete oldTables[i];
+	}
+	for (uint i = 0; i < STRING_CHUNKS; i++)
+		delete[] chunks[i];
+	for (size_t i = 0; i < blocks.size(); i++)
+		delete[] blocks[i];
+}
+
+// 32 bit FNV-1a
+uint StringInterner::hash(const char * str)
+{
+	uint h = 2166136261u;
+	while (*str)
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+	return h;
+}
+
+StringInterner::Entry &StringInterner::entry(uint id)
+{
+	return chunks[(id - 1) / STRING_CHUNK_SIZE][(id - 1) % STRING_CHUNK_SIZE];
+}
+
+// Returns the slot holding str, or the empty slot where it belongs.
+uint StringInterner::findSlot(const Table * t, const char * str, uint length, uint hash)
+{
+	uint i = hash & t->mask;
+	uint id;
+	while ((id = t->slots[i].load(std::memory_order_acquire)) != 0)
+	{
+		const Entry &e = entry(id);
+		if (e.hash == hash && e.length == length && memcmp(e.str, str, length) == 0)
+			break;
+		i = (i + 1) & t->mask;
+	}
+	return i;
+}
+
+StringInterner::Table * StringInterner::makeTable(uint mask)
+{
+	Table * t = new Table();
+	t->mask = mask;
+	t->slots = new std::atomic<uint>[mask + 1];
+	for (uint i = 0; i <= mask; i++)
+		t->slots[i].store(0, std::memory_order_relaxed);
+	return t;
+}
+
+// Fills a table twice the size and publishes it whole.
+void StringInterner::grow()
+{
+	Table * old = table.load(std::memory_order_relaxed);
+	Table * t = makeTable(old->mask * 2 + 1);
+	uint n = count.load(std::memory_order_relaxed);
+	for (uint id = 1; id <= n; id++)
+	{
+		uint i = entry(id).hash & t->mask;
+		while (t->slots[i].load(std::memory_order_relaxed) != 0)
+			i = (i + 1) & t->mask;
+		t->slots[i].store(id, std::memory_order_relaxed);
+	}
+	table.store(t, std::memory_order_release);
+	oldTables.push_back(old);
+}
+
+const char * StringInterner::store(const char * str, uint length)
+{
+	uint size = length + 1;
+	if (size > blockLeft)
+	{
+		uint blockSize = size > STRING_ARENA_BLOCK ? size : STRING_ARENA_BLOCK;
+		blockPos = new char[blockSize];
+		blockLeft = blockSize;
+		blocks.push_back(blockPos);
+	}
+	char * s = blockPos;
+	memcpy(s, str, size);
+	blockPos += size;
+	blockLeft -= size;
+	return s;
+}
+
+uint StringInterner::intern(const char * str)
+{
+	sf::Lock lock(mutex);
+	uint length = (uint)strlen(str);
+	uint h = hash(str);
+	Table * t = table.load(std::memory_order_relaxed);
+	uint i = findSlot(t, str, length, h);
+	uint id = t->slots[i].load(std::memory_order_relaxed);
+	if (id != 0)
+		return id;
+
+	id = count.load(std::memory_order_relaxed) + 1;
+	if (id > STRING_CHUNKS * STRING_CHUNK_SIZE)
+	{
+		printf("Error: too many names to intern %s.\n", str);
+		return 0;
+	}
+	Entry *&chunk = chunks[(id - 1) / STRING_CHUNK_SIZE];
+	if (chunk == NULL)
+		chunk = new Entry[STRING_CHUNK_SIZE];
+	Entry &e = entry(id);
+	e.str = store(str, length);
+	e.hash = h;
+	e.length = length;
+	// the entry is complete before anyone can see its id
+	count.store(id, std::memory_order_release);
+	t->slots[i].store(id, std::memory_order_release);
+	// keep the load factor under one half
+	if (id * 2 > t->mask)
+		grow();
+	return id;
+}
+
+uint StringInterner::find(const char * str)
+{
+	const Table * t = table.load(std::memory_order_acquire);
+	return t->slots[findSlot(t, str, (uint)strlen(str), hash(str))].load(std::memory_order_acquire);
+}
+
+const char * StringInterner::getStr(uint id)
+{
+	if (id == 0 || id > count.load(std::memory_order_acquire))
+		return "";
+	return entry(id).str;
+}
+
+uint StringInterner::getHash(uint id)
+{
+	if (id == 0 || id > count.load(std::memory_order_acquire))
+		return 0;
+	return entry(id).hash;
+}
+
+uint StringInterner::getSize()
+{
+	return count.load(std::memory_order_acquire);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+class StringInterner;
+
+#include <atomic>
+#include <vector>
+#include <SFML/System.hpp>
+
+typedef unsigned int uint;
+
+#define STRING_ARENA_BLOCK 4096
+#define STRING_CHUNK_SIZE 1024	// entries per chunk, chunks never move
+#define STRING_CHUNKS 4096		// so at most 4M strings
+
+// Compile time 32 bit FNV-1a, gives the same value as StringInterner::hash()
+constexpr uint hashString(const char * str, uint h = 2166136261u)
+{
+	return *str ? hashString(str + 1, (h ^ (unsigned char)*str) * 16777619u) : h;
+}
+
+// Global string pool. Every distinct string is stored once in arena blocks and gets a dense id
+// (0 means "no string"), so name -> id and id -> name are both O(1). Only intern() locks: an
+// entry is written before its id is published, entries never move and a grown slot table
+// replaces the old one atomically, so find() and getStr() never wait, even while the reload
+// thread interns new names.
+class StringInterner
+{
+	struct Entry
+	{
+		const char * str;
+		uint hash;
+		uint length;
+	};
+
+	struct Table
+	{
+		uint mask;
+		std::atomic<uint> * slots; // open addressing table of ids
+	};
+
+	Entry * chunks[STRING_CHUNKS]; // id - 1 is chunks[(id - 1) / STRING_CHUNK_SIZE][(id - 1) % STRING_CHUNK_SIZE]
+	std::atomic<uint> count;
+	std::atomic<Table *> table;
+	std::vector<Table *> oldTables; // a reader may still be probing them, freed with the pool
+	std::vector<char *> blocks;
+	char * blockPos;
+	uint blockLeft;
+	sf::Mutex mutex; // writers only
+
+	Entry &entry(uint id);
+	uint findSlot(const Table * t, const char * str, uint length, uint hash);
+	static Table * makeTable(uint mask);
+	void grow();
+	const char * store(const char * str, uint length);
+
+public:
+	StringInterner();
+	~StringInterner();
+
+	static uint hash(const char * str);
+
+	uint intern(const char * str);
+	uint find(const char * str);
+	const char * getStr(uint id);
+	uint getHash(uint id);
+	uint getSize();
+};
+
+extern StringInterner Strings;
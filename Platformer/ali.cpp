@@ -151,6 +151,42 @@
 #include "ali.h"
 #include <iostream>
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* The scanners below use SSE2, or AVX2 when the compiler targets it, to look at 
+ * 16 or 32 chars at a time.  Define ALI_CONFIG_NO_SIMD to use the plain loops. */
+#if !defined(ALI_CONFIG_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define ALI_VECTOR_SIZE 32
+typedef __m256i ali_vector;
+#define vector_load(p) _mm256_loadu_si256((const __m256i *) (p))
+#define vector_set(c) _mm256_set1_epi8(c)
+#define vector_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define vector_or(a, b) _mm256_or_si256(a, b)
+#define vector_mask(a) ((uint32_t) _mm256_movemask_epi8(a))
+#elif !defined(ALI_CONFIG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define ALI_VECTOR_SIZE 16
+typedef __m128i ali_vector;
+#define vector_load(p) _mm_loadu_si128((const __m128i *) (p))
+#define vector_set(c) _mm_set1_epi8(c)
+#define vector_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define vector_or(a, b) _mm_or_si128(a, b)
+#define vector_mask(a) ((uint32_t) _mm_movemask_epi8(a))
+#endif
+
+#if defined(ALI_VECTOR_SIZE) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #ifdef __cplusplus
 using namespace std;
 #endif
@@ -160,6 +196,12 @@ using namespace std;
  * is exceed, the structure is doubled in size. */
 #define ALI_CONFIG_DEFAULT_NESTED_ELEMENT_COUNT 8
 
+/* Default number of unread markup remembered per element, doubled when exceeded. */
+#define ALI_CONFIG_DEFAULT_MARKUP_COUNT 16
+
+/* Number of formats ali_in keeps compiled per document.  Past this the oldest is 
+ * replaced. */
+#define ALI_CONFIG_QUERY_CACHE_SIZE 16
 #define tag_none 2
 #define tag_element 3
 #define tag_attribute 4
@@ -172,17 +214,31 @@ using namespace std;
    not available.  The desire is to avoid adding code everywhere to check this.
    The solution is to have a type define with suitable properties. It only has
    the operaters deref(), =, and +.  deref is only valid if the value is within
-   the input.  It returns a value when valid, and throws an exception when not.
+   the input.  It returns a value when valid, and fails the ali_in() when not.
    This would be much nicer in c++!
  */
 typedef const char *ali_char;
 
 
 
-/* limit for number of elements inside an element that are not read, but 
- * need to be remembered incase they are wanted later. */
-#define ali_element_max 16      /*!< \internal */
-#define ali_element_none ali_element_max    /*!< \internal */
+/* No markup is being read. */
+#define ali_element_none -1     /*!< \internal */
+
+/* An ali_element_ref is a serial number with the element's depth in the low bits, 
+ * so the element is found in doc->elements without a search.  The depth bits also 
+ * limit how deeply elements may nest. */
+#define ali_depth_bits 10       /*!< \internal */
+#define ali_depth_max (1 << ali_depth_bits)    /*!< \internal */
+#define ali_serial_max ((1 << (31 - ali_depth_bits)) - 1)    /*!< \internal */
+
+/* Markup inside an element that is not read, but needs to be remembered 
+ * incase it's wanted later. */
+typedef struct
+{
+    ali_char name;
+    int16_t length;
+    int8_t type;    /* element or attribute.  tag_none once read. */
+} ali_markup_info;
 
 struct ali_element_info
 {
@@ -224,17 +280,23 @@ struct ali_element_info
     int32_t length;
     int8_t element_type;
     
-    /* Number of markup available. */
-    int16_t count;
-    
-    /* Note that the name + length allows reading of the contents of any
-     * element at anytime, allowing random access. */
-    ali_char markup_name[ali_element_max];
-    int16_t markup_length[ali_element_max];
-    int8_t markup_type[ali_element_max];    /* element or attribute */
+    /* Markup available, in document order.  Note that the name + length 
+     * allows reading of the contents of any element at anytime, allowing 
+     * random access.
+     * 
+     * Markup read leaves a hole rather than moving the markup after it, 
+     * so indexes stay valid.  Holes at either end are trimmed, so reading 
+     * in document order keeps just one.  The array belongs to the element's 
+     * slot in doc->elements and is reused by later elements in that slot, 
+     * it grows as needed. */
+    ali_markup_info *markups;
+    int32_t markups_size;
+    int32_t first;      /* first markup that isn't a hole */
+    int32_t count;      /* end of the markup, holes included */
+    int32_t live;       /* Number of markup available. */
     
     /* the last markup read */
-    int8_t last_markup_read;
+    int32_t last_markup_read;
     int8_t type_of_last_markup_read;    /* type of last markup read */
     ali_char last_markup_name;  /* allows for reading the next markup so
                                  * that out of order markup usage doesn't
@@ -280,22 +342,84 @@ typedef enum
     encoding_EBCDIC
 } encoding_type;
 
+typedef enum
+{
+    source_read,    /* a malloc'ed copy of the file, freed on close. */
+    source_mapped,  /* a read only mapping of the file, unmapped on close. */
+    source_memory   /* the caller's buffer, left alone on close. */
+} source_type;
+
 #define encoding_supported(x) ((x) <= encoding_US_ASCII)
 
+#define ali_query_max_steps 24   /*!< \internal */
+#define ali_query_max_text 128   /*!< \internal chars of prefix and suffix text in a query */
+#define ali_query_max_format 64  /*!< \internal longest format ali_in keeps compiled */
+
+typedef enum
+{
+    step_text,      /* chars required before the next input variable */
+    step_close,     /* '^': finish the markup read last, or pop up a level */
+    step_find,      /* "^e", "^a" and the others: find markup */
+    step_convert,   /* '%': input a variable */
+    step_invalid    /* an unrecognized XML instruction */
+} step_type;
+
+/* One step of a compiled format.  The format is split into these once, by 
+ * compile_format(), so running a query does no format parsing. */
+typedef struct
+{
+    uint8_t type;   /* step_type */
+    char code;      /* the markup type char of a find, or the conversion char */
+    bool optional;  /* find: "^o" */
+    bool enter;     /* find: make the markup the current element, for "^e", "^e^" and "^e%F" */
+    bool pop;       /* close: pop up a level if no markup was read */
+    bool long_arg;
+    bool short_arg;
+    bool long_double_arg;
+    bool byte_arg;
+    bool allocate;
+    uint8_t skip;   /* find: the step to continue at when the markup is missing */
+    uint8_t text;   /* text: the chars, convert: the suffix, as an offset into the query's text */
+    uint8_t length; /* text: number of chars */
+    uint32_t width;
+    char scan_format[8];    /* convert: the format passed to sscanf for numbers */
+} ali_query_step;
+
+struct ali_query
+{
+    uint8_t steps_count;
+    uint8_t text_used;
+    ali_query_step steps[ali_query_max_steps];
+    char text[ali_query_max_text];
+};
+
+/* A format ali_in compiled, kept for the next call with the same format. */
+typedef struct
+{
+    const char *format;     /* the caller's string, matched by address first */
+    char format_text[ali_query_max_format];  /* its chars, in case the caller reused it */
+    ali_query query;
+} ali_cached_query;
+
 struct ali_doc_info
 {
     FILE *file_in;
     ali_char text;
     ali_error error;
     /* Used to determine another unique ID. */
-    ali_element_ref next_element;
+    uint32_t next_serial;
     uint32_t size;
-    ali_char last_valid_char;
+    /* One past the last char of the input.  The text is not NUL terminated, reading 
+     * stops here instead and deref() returns a '\0' for it. */
+    ali_char text_end;
+    /* Where text came from, so ali_close knows how to let go of it. */
+    source_type source;
     ali_element_info *current_element;
     void *data;
     endian_type endian;
     encoding_type encoding;
-    jmp_buf environment;
+    /* Set by fail().  The ali_in() running stops and returns 0. */
+    bool failed;
 
     bool standalone;
     bool standalone_declared;
@@ -305,6 +429,12 @@ struct ali_doc_info
     ali_element_info *elements;
     uint16_t elements_size;
     uint16_t elements_count;
+
+    /* Formats compiled by ali_in, allocated on first use.  Callers pass the same few 
+     * string literals over and over, so most calls compile nothing. */
+    ali_cached_query *queries;
+    uint8_t queries_count;
+    uint8_t queries_next;   /* the entry replaced next once all are used */
 };
 
 
@@ -325,27 +455,140 @@ struct ali_doc_info
 #define PREPARE_LEAD_BYTE(c) ((c) = ((c) & (((c) < 0xdf) ? 0x1f : ((c) < 0xdf) ? 0x0f : 0x07)))
 
 
-/* Returns the char at c, or sets ALI_ERROR_DATA_INCOMPLETE if c is invalid, and jumps to the
- * end of ali_in().
+/* Stops the ali_in() running with an error.  Everything that can fail returns early 
+ * once doc->failed is set, and run_query() returns 0 without storing anything more.
+ * The first error is kept, later ones are side effects of stopping.
  * 
- * This uses the setjmp/longjump pair.  It greatly simplies the code and reduces 
- * overhead at the cost of requiring a setjmp implementation.  Hopefully this is 
- * a good tradeoff.  Nesting is not needed, so a try/catch C implementation was 
- * not used.  But this issue is a major reason to switch to C++. */
+ * This used to longjmp to a setjmp in ali_in().  Checking a flag on the way out costs 
+ * less than a setjmp for every ali_in(), and doesn't jump to a stale setjmp when a 
+ * %F callback's own ali_in() calls have replaced it. */
+static void
+fail(
+   ali_doc_info * doc,
+   ali_error error)
+{
+   if (!doc->failed)
+   {
+      doc->error = error;
+      doc->failed = true;
+   }
+}
+
+
+/* Returns the char at c.  Past the end of the input it fails with 
+ * ALI_ERROR_DATA_INCOMPLETE and reads as the end, a '\0', so loops reading on stop. */
 static uint8_t
 deref(
    ali_doc_info * doc,
    ali_char c)
 {
-   if (c > doc->last_valid_char)
+   if (c >= doc->text_end)
    {
-      doc->error = ALI_ERROR_DATA_INCOMPLETE;
-      longjmp(doc->environment, ALI_ERROR_DATA_INCOMPLETE);
+      /* The end of the input reads as the terminator the text used to carry. */
+      if (c > doc->text_end)
+         fail(doc, ALI_ERROR_DATA_INCOMPLETE);
+      return '\0';
    }
    return *c;
 }
 
 
+/* True if the input at c starts with the first length chars of s.  Used in place of 
+ * strncmp() on the input, which has no NUL to stop at when it ends with the mapping. */
+static bool
+input_matches(
+   const ali_doc_info * doc,
+   ali_char c,
+   const char * s,
+   int32_t length)
+{
+   return length <= doc->text_end - c && memcmp(c, s, length) == 0;
+}
+
+
+#if defined(ALI_VECTOR_SIZE)
+/* Index of the lowest set bit.  mask must not be 0. */
+static int
+first_bit(
+   uint32_t mask)
+{
+#if defined(_MSC_VER)
+   unsigned long index;
+
+   _BitScanForward(&index, mask);
+   return (int) index;
+#else
+   return __builtin_ctz(mask);
+#endif
+}
+
+
+static int
+bit_count(
+   uint32_t mask)
+{
+   int count = 0;
+
+   for (; mask != 0; mask &= mask - 1)
+      count++;
+   return count;
+}
+#endif
+
+
+/* Returns the first char from c on that is one of stops (up to 4 chars) or a '\0', or 
+ * end if there is none.  Nothing at or past end is read.  The loops skipping markup 
+ * and content use this to pass over the chars they don't care about, rather than 
+ * going through deref() one char at a time. */
+static ali_char
+scan_to(
+   ali_char c,
+   ali_char end,
+   const char * stops)
+{
+   char s[4];
+   int count = (int) strlen(stops);
+   int i;
+
+
+   /* Pad with the first stop, so there are always four to compare with. */
+   assert(count <= 4);
+   for (i = 0; i < 4; i++)
+      s[i] = i < count ? stops[i] : stops[0];
+
+#if defined(ALI_VECTOR_SIZE)
+   if (end - c >= ALI_VECTOR_SIZE)
+   {
+      const ali_vector zero = vector_set(0);
+      const ali_vector s0 = vector_set(s[0]);
+      const ali_vector s1 = vector_set(s[1]);
+      const ali_vector s2 = vector_set(s[2]);
+      const ali_vector s3 = vector_set(s[3]);
+
+      do
+      {
+         ali_vector v = vector_load(c);
+         uint32_t mask = vector_mask(vector_or(
+            vector_or(vector_or(vector_eq(v, s0), vector_eq(v, s1)), vector_or(vector_eq(v, s2), vector_eq(v, s3))),
+            vector_eq(v, zero)));
+
+         if (mask != 0)
+            return c + first_bit(mask);
+         c += ALI_VECTOR_SIZE;
+      }
+      while (end - c >= ALI_VECTOR_SIZE);
+   }
+#endif
+
+   for (; c < end; c++)
+   {
+      if (*c == '\0' || *c == s[0] || *c == s[1] || *c == s[2] || *c == s[3])
+         break;
+   }
+   return c;
+}
+
+
 static int
 skip_whitespace(
    ali_element_info * element)
@@ -359,6 +602,44 @@ skip_whitespace(
 
    c = element->pos;
 
+#if defined(ALI_VECTOR_SIZE)
+   /* A vector of whitespace at a time, leaving the loop below to finish.  Every LF counts 
+    * a line, a CR only does until some other whitespace has been seen, as in the loop. */
+   if (element->doc->text_end - c >= ALI_VECTOR_SIZE &&
+      (*c == ' ' || *c == '\t' || *c == 0x0a || *c == 0x0d))
+   {
+      const ali_vector space = vector_set(' ');
+      const ali_vector tab = vector_set('\t');
+      const ali_vector lf = vector_set(0x0a);
+      const ali_vector cr = vector_set(0x0d);
+
+      do
+      {
+         ali_vector v = vector_load(c);
+         uint32_t crs = vector_mask(vector_eq(v, cr));
+         uint32_t lfs = vector_mask(vector_eq(v, lf));
+         uint32_t others = vector_mask(vector_or(vector_eq(v, space), vector_eq(v, tab))) | lfs;
+         uint32_t stop = ~(crs | others);
+         int length = stop != 0 ? first_bit(stop) : ALI_VECTOR_SIZE;
+         uint32_t run = length < 32 ? (1u << length) - 1 : 0xffffffff;
+
+         lfs &= run;
+         others &= run;
+         element->line_number += bit_count(lfs);
+         if (!last_char_was_linefeed)
+         {
+            element->line_number += bit_count(crs & (others != 0 ? (1u << first_bit(others)) - 1 : run));
+            last_char_was_linefeed = others != 0;
+         }
+
+         c += length;
+         if (length < ALI_VECTOR_SIZE)
+            break;
+      }
+      while (element->doc->text_end - c >= ALI_VECTOR_SIZE);
+   }
+#endif
+
    for (;;)
    {
       safe_c = deref(element->doc, c);
@@ -417,12 +698,12 @@ skip_dtd(
 
    c = element->pos;
 
-   if (strncmp(element->pos, "<!DOCTYPE", 9) == 0)
+   if (input_matches(element->doc, element->pos, "<!DOCTYPE", 9))
    {
       c += 9;
       
       /*! \DOLATER handle all DTD formats. */
-      while (deref(element->doc, c) != 0 && strncmp(c, ">", 1) != 0)
+      while (deref(element->doc, c) != 0 && *c != '>')
       {
          c++;
       }
@@ -442,11 +723,12 @@ skip_to_end_of_comment(
 
    /* the tag is a comment.  Skip to the end of the comment.
     * http://www.w3.org/TR/REC-xml#NT-Comment */
+   element->pos = scan_to(element->pos, element->doc->text_end, "-");
    safe_c = deref(element->doc, element->pos);
    while (safe_c != '\0' &&
-      (element->pos[0] != '-' || element->pos[1] != '-' || element->pos[2] != '>'))
+      (safe_c != '-' || deref(element->doc, element->pos + 1) != '-' || deref(element->doc, element->pos + 2) != '>'))
    {
-      element->pos++;
+      element->pos = scan_to(element->pos + 1, element->doc->text_end, "-");
       safe_c = deref(element->doc, element->pos);
    }
 
@@ -462,11 +744,12 @@ skip_to_end_of_processing_instruction(
 
    /* the tag is a processing instruction.  Skip to the end of the instruction.
     * http://www.w3.org/TR/REC-xml#NT-PI */
+   element->pos = scan_to(element->pos, element->doc->text_end, "?");
    safe_c = deref(element->doc, element->pos);
    while (safe_c != '\0' &&
-      (safe_c != '?' || element->pos[1] != '>'))
+      (safe_c != '?' || deref(element->doc, element->pos + 1) != '>'))
    {
-      element->pos++;
+      element->pos = scan_to(element->pos + 1, element->doc->text_end, "?");
       safe_c = deref(element->doc, element->pos);
    }
 
@@ -698,6 +981,8 @@ skip_element_tag(
    /* There must be either whitespace or '>', or else the element's tag had an unacceptable
     * character. Also except '=' for attributes. */
    safe_c = deref(element->doc, c);
+   if (element->doc->failed)
+      return;
    if (tag_length == 0 ||
        (safe_c != '>' && safe_c != '=' && safe_c != ' ' && safe_c != '\t' && safe_c != 0x0a &&
         safe_c != 0x0d))
@@ -761,7 +1046,7 @@ skip_content(
 
    assert(element != NULL);
 
-   c = element->pos;
+   c = scan_to(element->pos, element->doc->text_end, "</");
    safe_c = deref(element->doc, c);
    while (safe_c != '\0')
    {
@@ -770,7 +1055,7 @@ skip_content(
          can_be_empty_element = false;
 
          /* http://www.w3.org/TR/REC-xml#NT-ETag */
-         if (deref(element->doc, c + 1) == '/' && strncmp(name, c + 2, length) == 0)
+         if (deref(element->doc, c + 1) == '/' && input_matches(element->doc, c + 2, name, length))
          {
             open_end_element_tag++;
 
@@ -799,10 +1084,10 @@ skip_content(
 
             do
             {
-               c++;
+               c = scan_to(c + 1, element->doc->text_end, "-");
                safe_c = deref(element->doc, c);
             }
-            while (!(safe_c == '-' && *(c + 1) == '-' && *(c + 2) == '>') && safe_c != '\0');
+            while (!(safe_c == '-' && deref(element->doc, c + 1) == '-' && deref(element->doc, c + 2) == '>') && safe_c != '\0');
 
             if (safe_c != '\0')
                c += 3 - 1;  /* move to the '>' in "-->".  It will be skipped shortly. */
@@ -811,16 +1096,19 @@ skip_content(
 
          }
          /* http://www.w3.org/TR/REC-xml#NT-STag */
-         else if (strncmp(name, c + 1, length) == 0)
+         else if (input_matches(element->doc, c + 1, name, length))
          {
             c += length;
 
             do
             {
-               c++;
+               c = scan_to(c + 1, element->doc->text_end, ">");
                safe_c = deref(element->doc, c);
             }
-            while (safe_c != '>');
+            while (safe_c != '>' && !element->doc->failed);
+
+            if (element->doc->failed)
+               return false;
 
             /* handle empty elements by not counting them
              * http://www.w3.org/TR/REC-xml#NT-EmptyElemTag */
@@ -837,7 +1125,8 @@ skip_content(
       }
 
 
-      c++;
+      /* Only '<' matters after content has been seen. */
+      c = scan_to(c + 1, element->doc->text_end, can_be_empty_element ? "</" : "<");
       safe_c = deref(element->doc, c);
    }
 
@@ -851,6 +1140,42 @@ skip_content(
  * it's wanted, repeating until found or no more elements. 
  */
 
+/* Appends markup to the element's list of unread markup, growing it if needed.
+ * Returns NULL if it can't grow. */
+static ali_markup_info *
+add_markup(
+   ali_element_info * element,
+   ali_char name,
+   int8_t type)
+{
+   ali_markup_info *markup;
+
+
+   if (element->count >= element->markups_size)
+   {
+      ali_markup_info *markups;
+      int32_t size = element->markups_size == 0 ? ALI_CONFIG_DEFAULT_MARKUP_COUNT : element->markups_size * 2;
+
+      markups = (ali_markup_info *) ali_realloc(element->markups, size * sizeof(*markups));
+      if (markups == NULL)
+      {
+         fail(element->doc, ALI_ERROR_MEMORY_FAILURE);
+         return NULL;
+      }
+      element->markups = markups;
+      element->markups_size = size;
+   }
+
+   markup = &element->markups[element->count++];
+   markup->name = name;
+   markup->length = 0;
+   markup->type = type;
+   element->live++;
+
+   return markup;
+}
+
+
 /* This function expects element->pos to be outside of the elements to find.  When it finds an
  * unknown closing tag or end of input, then it assumes it found all elements. */
 
@@ -868,6 +1193,7 @@ read_one_markup(
    char terminator;
    uint8_t safe_c;
    ali_char starting_pos = element->pos;
+   ali_markup_info *markup;
 
 
    assert(element != NULL);
@@ -907,14 +1233,13 @@ read_one_markup(
          element->pos += 1;     /* Skip '=' */
          skip_whitespace(element);
 
+         char stops[2];
+
          terminator = deref(element->doc, element->pos++);
 
-         safe_c = deref(element->doc, element->pos);
-         while (safe_c != terminator && safe_c != '\0')
-         {
-            element->pos++;
-            safe_c = deref(element->doc, element->pos);
-         }
+         stops[0] = terminator;
+         stops[1] = '\0';
+         element->pos = scan_to(element->pos, element->doc->text_end, stops);
 
          element->pos++;        /* skip terminator */
       }
@@ -928,12 +1253,8 @@ read_one_markup(
           * 
           * http://www.w3.org/TR/REC-xml#NT-STag 
           * http://www.w3.org/TR/REC-xml#NT-EmptyElemTag */
+         c = scan_to(c, element->doc->text_end, ">");
          safe_c = deref(element->doc, c);
-         while (safe_c != '\0' && safe_c != '>')
-         {
-            c++;
-            safe_c = deref(element->doc, c);
-         }
 
          if (safe_c == '>' && *(c - 1) == '/')
          {
@@ -965,6 +1286,9 @@ read_one_markup(
 
       else if (element->type_of_last_markup_read == tag_instruction)
          skip_to_end_of_processing_instruction(element);
+
+      if (element->doc->failed)
+         return false;
    }
 
 
@@ -1013,16 +1337,16 @@ read_one_markup(
          element->pos++;
          safe_c = deref(element->doc, element->pos);
 
-         if (safe_c == '!' && element->pos[1] == '-' && element->pos[2] == '-')
+         if (safe_c == '!' && deref(element->doc, element->pos + 1) == '-' && deref(element->doc, element->pos + 2) == '-')
          {
             /* Read comment.  No text is kept for the markup name. */
-            element->markup_name[element->count] = element->pos - 1;
-            element->markup_type[element->count] = tag_comment;
+            markup = add_markup(element, element->pos - 1, tag_comment);
+            if (markup == NULL)
+               return false;
             element->last_markup_name = element->pos - 1;
-            element->markup_length[element->count] = 0;
-            element->last_markup_name_length = element->markup_length[element->count];
+            markup->length = 0;
+            element->last_markup_name_length = markup->length;
             element->type_of_last_markup_read = tag_comment;
-            element->count++;
          }
          else if (safe_c == '?')
          {
@@ -1030,24 +1354,24 @@ read_one_markup(
 			    * is set to the PITarget.
              * http://www.w3.org/TR/REC-xml#NT-PITarget */
             element->pos++;
-            element->markup_name[element->count] = element->pos;
-            element->markup_type[element->count] = tag_instruction;
+            markup = add_markup(element, element->pos, tag_instruction);
+            if (markup == NULL)
+               return false;
             element->last_markup_name = element->pos;
-            skip_element_tag(element, &element->markup_length[element->count]);
-            element->last_markup_name_length = element->markup_length[element->count];
+            skip_element_tag(element, &markup->length);
+            element->last_markup_name_length = markup->length;
             element->type_of_last_markup_read = tag_instruction;
-            element->count++;
          }
          else
          {
             /* Read start tag. */
-            element->markup_name[element->count] = element->pos;
-            element->markup_type[element->count] = tag_element;
+            markup = add_markup(element, element->pos, tag_element);
+            if (markup == NULL)
+               return false;
             element->last_markup_name = element->pos;
-            skip_element_tag(element, &element->markup_length[element->count]);
-            element->last_markup_name_length = element->markup_length[element->count];
+            skip_element_tag(element, &markup->length);
+            element->last_markup_name_length = markup->length;
             element->type_of_last_markup_read = tag_element;
-            element->count++;
          }
          break;
 
@@ -1084,13 +1408,13 @@ read_one_markup(
             if (safe_c != '>')
             {
             /* Read attribute tag. */
-            element->markup_name[element->count] = element->pos;
-            element->markup_type[element->count] = tag_attribute;
+            markup = add_markup(element, element->pos, tag_attribute);
+            if (markup == NULL)
+               return false;
             element->last_markup_name = element->pos;
-            skip_element_tag(element, &element->markup_length[element->count]);
-            element->last_markup_name_length = element->markup_length[element->count];
+            skip_element_tag(element, &markup->length);
+            element->last_markup_name_length = markup->length;
             element->type_of_last_markup_read = tag_attribute;
-            element->count++;
 
             break;
             }
@@ -1102,10 +1426,10 @@ read_one_markup(
          }
       }
    }
-   while (element->pos < element->doc->last_valid_char);
+   while (element->pos < element->doc->text_end);
 
 
-   return element->pos < element->doc->last_valid_char && deref(element->doc, element->pos) != '<';
+   return element->pos < element->doc->text_end && deref(element->doc, element->pos) != '<';
 }
 
 
@@ -1117,6 +1441,7 @@ read_all_element_tags(
    ali_element_info * element)
 {
    char terminator;
+   ali_markup_info *markup;
 
 
    assert(element != NULL);
@@ -1145,10 +1470,10 @@ read_all_element_tags(
          element->start_tag_closed = true;
 
          /* Read start tag. */
-         element->markup_name[element->count] = element->pos;
-         element->markup_type[element->count] = tag_element;
-         skip_element_tag(element, &element->markup_length[element->count]);
-         element->count++;
+         markup = add_markup(element, element->pos, tag_element);
+         if (markup == NULL)
+            return false;
+         skip_element_tag(element, &markup->length);
 
          skip_whitespace(element);
          c = element->pos;
@@ -1211,12 +1536,12 @@ read_all_element_tags(
             /* read attribute */
 
             /* Read attribute tag. */
-            element->markup_name[element->count] = element->pos;
-            element->markup_type[element->count] = tag_attribute;
-            element->count++;
+            markup = add_markup(element, element->pos, tag_attribute);
+            if (markup == NULL)
+               return false;
 
             /* http://www.w3.org/TR/REC-xml#NT-Attribute */
-            skip_element_tag(element, &element->markup_length[element->count - 1]);
+            skip_element_tag(element, &markup->length);
             element->pos += 1;  /* Skip '=' */
             skip_whitespace(element);
 
@@ -1255,6 +1580,7 @@ decode_string(
    uint32_t oldSize;
    char *result;
    char *c;
+   uint8_t safe_c;
 
 
    assert(start != NULL);
@@ -1276,8 +1602,8 @@ decode_string(
           result = (char *) malloc(sizeof(*result) * size);
           if (result == NULL)
           {
-             doc->error = ALI_ERROR_MEMORY_FAILURE;
-             longjmp(doc->environment, ALI_ERROR_MEMORY_FAILURE);
+             fail(doc, ALI_ERROR_MEMORY_FAILURE);
+             return NULL;
           }
       }
       c = result;
@@ -1290,8 +1616,8 @@ decode_string(
       result = (char *) realloc(string, sizeof(*result) * size);
       if (result == NULL)
       {
-         doc->error = ALI_ERROR_MEMORY_FAILURE;
-         longjmp(doc->environment, ALI_ERROR_MEMORY_FAILURE);
+         fail(doc, ALI_ERROR_MEMORY_FAILURE);
+         return NULL;
       }
       c = &result[oldSize];
    }
@@ -1310,54 +1636,70 @@ decode_string(
           * into that entity list instead of special casing them like this. */
          if (*start == '&')
          {
-            if (strncmp(start, "&lt", 3) == 0)
+            if (input_matches(doc, start, "&lt", 3))
             {
                *c++ = '<';
                dest_size--;
                start += 3;
             }
-            else if (strncmp(start, "&gt", 3) == 0)
+            else if (input_matches(doc, start, "&gt", 3))
             {
                *c++ = '>';
                dest_size--;
                start += 3;
             }
-            else if (strncmp(start, "&amp", 4) == 0)
+            else if (input_matches(doc, start, "&amp", 4))
             {
                *c++ = '&';
                dest_size--;
                start += 4;
             }
-            else if (strncmp(start, "&apos", 5) == 0)
+            else if (input_matches(doc, start, "&apos", 5))
             {
                *c++ = '\'';
                dest_size--;
                start += 5;
             }
-            else if (strncmp(start, "&quot", 5) == 0)
+            else if (input_matches(doc, start, "&quot", 5))
             {
                *c++ = '"';
                dest_size--;
                start += 5;
             }
-            else if (*(start + 1) == '#')
+            else if (deref(doc, start + 1) == '#')
             {
-               long unsigned int v;
+               long unsigned int v = 0;
+               ali_char digit;
                
                /* http://www.w3.org/TR/REC-xml#dt-charref */
-               /* Characters may be one, two or four byte values */
+               /* Characters may be one, two or four byte values.  The digits are 
+                * converted here, sscanf would not stop at the end of the input. */
                start += 2;
-               if (*start == 'x')
+               safe_c = deref(doc, start);
+               if (doc->failed)
+                  break;
+               if (safe_c == 'x')
                {
                   start += 1;
-                  sscanf_s(start, "%lx", &v);
+                  for (digit = start; digit <= end; digit++)
+                  {
+                     if ('0' <= *digit && *digit <= '9')
+                        v = v * 16 + (*digit - '0');
+                     else if ('a' <= (*digit | 0x20) && (*digit | 0x20) <= 'f')
+                        v = v * 16 + ((*digit | 0x20) - 'a' + 10);
+                     else
+                        break;
+                  }
                }
                else
                {
-                  sscanf_s(start, "%ld", (long int *)&v);
+                  for (digit = start; digit <= end && '0' <= *digit && *digit <= '9'; digit++)
+                     v = v * 10 + (*digit - '0');
                }
                
-               /* a utf32to8 converter. */
+               /* a utf32to8 converter.  Stop if the char doesn't fit, dest_size is unsigned. */
+               if (dest_size < (v <= 0x007F ? 1u : v <= 0x07FF ? 2u : v <= 0xFFFF ? 3u : 4u))
+                  break;
                if (v <= 0x007F)
                {
                   *c++ = (unsigned char)v;
@@ -1385,22 +1727,23 @@ decode_string(
             }
             
             /* skip the trailing ';'. */
-            while ((('0' <= *start && *start <= '9') ||
+            while (start < end &&
+               (('0' <= *start && *start <= '9') ||
                   ('a' <= *start && *start <= 'f') ||
-                  ('A' <= *start && *start <= 'F')) &&
-               start < end)
+                  ('A' <= *start && *start <= 'F')))
             {
                start++;
             }
-            if (*start == '\0')
+            safe_c = deref(doc, start);
+            if (safe_c == '\0')
             {
-               doc->error = ALI_ERROR_DATA_INCOMPLETE;
-               longjmp(doc->environment, ALI_ERROR_DATA_INCOMPLETE);
+               fail(doc, ALI_ERROR_DATA_INCOMPLETE);
+               break;
             }
-            else if (*start != ';')
+            else if (safe_c != ';')
             {
-               doc->error = ALI_ERROR_TAG_INVALID;
-               longjmp(doc->environment, ALI_ERROR_TAG_INVALID);
+               fail(doc, ALI_ERROR_TAG_INVALID);
+               break;
             }
             start++;
          }
@@ -1429,12 +1772,12 @@ decode_string(
             dest_size--;
             start++;
          }
-         else if (*start == '<' && strncmp(start, "<![CDATA", 8) == 0)
+         else if (*start == '<' && input_matches(doc, start, "<![CDATA[", 9))
          {
-            start += 8;
+            start += 9;
 
             while (start <= end && dest_size > 0 && 
-               *start != ']' && strncmp(start, "]]>", 3) != 0)
+               !input_matches(doc, start, "]]>", 3))
             {
                *c++ = *start++;
                dest_size--;
@@ -1476,6 +1819,14 @@ decode_string(
             dest_size--;
          }
       }
+
+      /* Stopped at a bad entity.  What was decoded before it stays in dest, unterminated. */
+      if (doc->failed)
+      {
+         if (string == NULL && dest == NULL)
+            free(result);
+         return NULL;
+      }
    }
    else
    {
@@ -1529,6 +1880,7 @@ get_content(
    uint8_t safe_c;
    int markup_type;
    uint32_t width_remaining = dest_size; /* limit the chars read to the width */
+   char stops[5];    /* chars the content loop needs to look at */
 
 
    assert(element != NULL);
@@ -1536,7 +1888,7 @@ get_content(
    assert(suffix != NULL);
 
    if (element->last_markup_read != ali_element_none)
-      markup_type = element->markup_type[element->last_markup_read];
+      markup_type = element->markups[element->last_markup_read].type;
    else
       markup_type = element->element_type;
 
@@ -1546,8 +1898,8 @@ get_content(
       /* advance to just after the markup_name's end. */
       if (element->last_markup_read != ali_element_none)
       {
-         element->pos = &element->markup_name[element->last_markup_read]
-         [element->markup_length[element->last_markup_read]];
+         element->pos = &element->markups[element->last_markup_read].name
+         [element->markups[element->last_markup_read].length];
       }
       else
       {
@@ -1560,12 +1912,8 @@ get_content(
       if (advance_to_content)
       {
          /* http://www.w3.org/TR/REC-xml#NT-AttValue */
+         element->pos = scan_to(element->pos, element->doc->text_end, "\"'");
          safe_c = deref(element->doc, element->pos);
-         while (safe_c != '"' && safe_c != '\'' && safe_c != '\0')
-         {
-            element->pos++;
-            safe_c = deref(element->doc, element->pos);
-         }
          element->pos++;
 
          terminator = safe_c;
@@ -1574,8 +1922,8 @@ get_content(
       {
          /* need to recover the terminator.  It's after the markup_name. */
          ali_char temp = element->pos;
-         element->pos = &element->markup_name[element->last_markup_read]
-                         [element->markup_length[element->last_markup_read]];
+         element->pos = &element->markups[element->last_markup_read].name
+                         [element->markups[element->last_markup_read].length];
          skip_whitespace(element);
          element->pos++;
          skip_whitespace(element);
@@ -1594,12 +1942,8 @@ get_content(
       if (advance_to_content)
       {
          /* http://www.w3.org/TR/REC-xml#NT-AttValue */
+         element->pos = scan_to(element->pos, element->doc->text_end, ">");
          safe_c = deref(element->doc, element->pos);
-         while (safe_c != '>' && safe_c != '\0')
-         {
-            element->pos++;
-            safe_c = deref(element->doc, element->pos);
-         }
          element->start_tag_closed = true;
 
          if (safe_c == '>' && *(element->pos - 1) == '/')
@@ -1657,21 +2001,27 @@ get_content(
 
    attribute_start = element->pos;
 
+   stops[0] = terminator;
+   stops[1] = '&';
+   stops[2] = '<';
+   stops[3] = *suffix;
+   stops[4] = '\0';
+
    suffix_length = strlen(suffix);
    if (width_remaining == 0)
       width_remaining = 0xffffffff;
    safe_c = deref(element->doc, element->pos);
-   while (width_remaining-- > 0 &&
+   while (width_remaining-- > 0 && !element->doc->failed &&
       (safe_c != terminator ||
-         (terminator == '<' && strncmp(element->pos, "<![CDATA", 8) == 0) ||
-         (terminator == '-' && element->pos[1] != '-' && element->pos[2] != '>') ||
-         (terminator == '?' && element->pos[1] != '>')))
+         (terminator == '<' && input_matches(element->doc, element->pos, "<![CDATA", 8)) ||
+         (terminator == '-' && deref(element->doc, element->pos + 1) != '-' && deref(element->doc, element->pos + 2) != '>') ||
+         (terminator == '?' && deref(element->doc, element->pos + 1) != '>')))
    {
       if (safe_c == *suffix)
       {
          /* DOLATER whitespace isn't checked correctly.  Any whitespace should match any
           * whitespace, so strncmp can't really be used. */
-         if (strncmp(element->pos, suffix, suffix_length) == 0)
+         if (input_matches(element->doc, element->pos, suffix, suffix_length))
             break;
       }
 
@@ -1679,20 +2029,20 @@ get_content(
        * in terms of width counting. */
       if (safe_c == '&' && markup_type == tag_element)
       {
-         while (safe_c != ';')
+         while (safe_c != ';' && !element->doc->failed)
             safe_c = deref(element->doc, ++element->pos);
       }
 
       /* advance through CDATA zones.
        * DOLATER: notice that we don't respect width or the suffix. 
        * Resuming such partial reads means keeping more state. */
-      if (safe_c == '<' && strncmp(element->pos, "<![CDATA", 8) == 0 &&
+      if (safe_c == '<' && input_matches(element->doc, element->pos, "<![CDATA", 8) &&
          markup_type == tag_element)
       {
          width_remaining++;
          element->pos += 8;
          safe_c = deref(element->doc, element->pos);
-         while (safe_c != '\0' && safe_c != ']' && strncmp(element->pos, "]]>", 3) != 0)
+         while (safe_c != '\0' && safe_c != ']' && !input_matches(element->doc, element->pos, "]]>", 3))
          {
             element->pos++;
             safe_c = deref(element->doc, element->pos);
@@ -1707,11 +2057,28 @@ get_content(
       }
       else
       {
+         /* Skip the chars that can't end the content or need handling, as far as the 
+          * width allows.  Each costs one of the width like the char just passed. */
+         ali_char limit = element->doc->text_end;
+
          element->pos++;
+         if (element->pos < limit)
+         {
+            ali_char next;
+
+            if ((uint32_t) (limit - element->pos) > width_remaining)
+               limit = element->pos + width_remaining;
+            next = scan_to(element->pos, limit, stops);
+            width_remaining -= (uint32_t) (next - element->pos);
+            element->pos = next;
+         }
          safe_c = deref(element->doc, element->pos);
       }
    }
 
+   if (element->doc->failed)
+      return NULL;
+
    attribute_end = element->pos - 1;
 
    /* Check that the suffix was obeyed.  If the terminator was reached but there was a suffix, then 
@@ -1742,7 +2109,7 @@ get_next_xml_declaration(
    skip_whitespace(element);
    
    name_length = strlen(name);
-   if (strncmp(name, element->pos, name_length) == 0)
+   if (input_matches(doc, element->pos, name, name_length))
    {
        element->pos += name_length;
 
@@ -1767,12 +2134,12 @@ get_next_xml_declaration(
        {
            element->pos++;
        }
-       while (deref(element->doc, element->pos) != terminator);
+       while (deref(element->doc, element->pos) != terminator && !doc->failed);
        
        element->pos++;
    }
    
-   return value;
+   return doc->failed ? NULL : value;
 }
 
 /*! \brief Parse an XML declaration. 
@@ -1795,11 +2162,13 @@ parse_xml_declaration(
     * http://www.w3.org/TR/REC-xml/#NT-XML_Decl
     * Do encodings we handle first.
     */
-   if (strncmp("<?xml", element->pos, 5) == 0)
+   if (input_matches(doc, element->pos, "<?xml", 5))
    {
        element->pos += 5;
 
        version = get_next_xml_declaration(doc, element, "version");
+       if (doc->failed)
+          return doc->error;
        if (version == NULL)
        {
            doc->error = ALI_ERROR_XML_DECLARATION_INVALID;
@@ -1807,6 +2176,8 @@ parse_xml_declaration(
        else
        {
            encoding = get_next_xml_declaration(doc, element, "encoding");
+           if (doc->failed)
+              return doc->error;
 
            /* Compare the encoding to those we know about to identify them. 
             * This overrides earlier encoding gueses. */
@@ -1826,6 +2197,8 @@ parse_xml_declaration(
 
            /* http://www.w3.org/TR/REC-xml/#NT-SDDecl */
            standalone = get_next_xml_declaration(doc, element, "standalone");
+           if (doc->failed)
+              return doc->error;
            if (standalone != NULL)
            {
                if (_strnicmp(standalone, "yes", 3) == 0)
@@ -1845,7 +2218,7 @@ parse_xml_declaration(
 
            skip_whitespace(element);
            
-           if (strncmp("?>", element->pos, 2) != 0)
+           if (!input_matches(doc, element->pos, "?>", 2))
            {
                doc->error = ALI_ERROR_XML_DECLARATION_INVALID;
            }
@@ -1921,8 +2294,8 @@ remove_markup(
    int i)
 {
    assert(current_element != NULL);
-   assert(i >= 0);
-   assert(i < ali_element_max);
+   assert(i >= current_element->first);
+   assert(i < current_element->count);
 
    /* advance current_element->pos past the end of the markup */
    if (current_element->last_markup_read != ali_element_none)
@@ -1967,20 +2340,22 @@ remove_markup(
          skip_to_end_of_processing_instruction(current_element);
    }
 
-   /* If we needed to keep the info around for use, we could alternatively mark the element as read 
-    * and free all later.  This is slightly preferred for now for better performance.  Is this
-    * optimizing too soon? Requirements unclear. */
-   if (current_element->count > 1 && current_element->count < ali_element_max - 1)
+   /* Leave a hole instead of moving the later markup down, then trim the ends. */
+   current_element->markups[i].type = tag_none;
+   current_element->markups[i].name = NULL;  /* clarify for debugging */
+   current_element->live--;
+   if (current_element->live == 0)
+   {
+      current_element->first = 0;
+      current_element->count = 0;
+   }
+   else
    {
-      memcpy((void *) &current_element->markup_name[i], &current_element->markup_name[i + 1],
-         (current_element->count - (i + 1)) * sizeof(current_element->markup_name[i]));
-      current_element->markup_name[current_element->count - 1] = NULL;  /* clarify for debugging */
-      memcpy(&current_element->markup_length[i], &current_element->markup_length[i + 1],
-         (current_element->count - (i + 1)) * sizeof(current_element->markup_length[i]));
-      memcpy(&current_element->markup_type[i], &current_element->markup_type[i + 1],
-         (current_element->count - (i + 1)) * sizeof(current_element->markup_type[i]));
+      while (current_element->markups[current_element->count - 1].type == tag_none)
+         current_element->count--;
+      while (current_element->markups[current_element->first].type == tag_none)
+         current_element->first++;
    }
-   current_element->count--;
 
    current_element->last_markup_read = ali_element_none;
    current_element->type_of_last_markup_read = tag_none;
@@ -2001,28 +2376,41 @@ new_current_element(
 
    assert(doc != NULL);
 
+   /* The element's depth must fit in its ali_element_ref. */
+   if (doc->elements_count >= ali_depth_max)
+   {
+      fail(doc, ALI_ERROR_MEMORY_FAILURE);
+      return;
+   }
+
    /* Make sure there is space for another element */
    if (doc->elements_count >= doc->elements_size)
    {
+      ali_element_info *elements;
+      uint16_t size;
+      uint16_t i;
+
       /* Resize the elements to add one more */
       if (doc->elements_size == 0)
-      {
-         doc->elements_size = ALI_CONFIG_DEFAULT_NESTED_ELEMENT_COUNT;
-         doc->elements = (ali_element_info *) malloc(doc->elements_size * sizeof(*(doc->elements)));
-      }
+         size = ALI_CONFIG_DEFAULT_NESTED_ELEMENT_COUNT;
       else
+         size = (uint16_t) (doc->elements_size * 2);
+
+      elements = (ali_element_info *) ali_realloc(doc->elements, size * sizeof(*elements));
+      if (elements == NULL)
       {
-         doc->elements_size = (uint16_t) (doc->elements_size * 2);
-         doc->elements =
-            (ali_element_info *) realloc(doc->elements,
-            doc->elements_size * sizeof(*(doc->elements)));
+         fail(doc, ALI_ERROR_MEMORY_FAILURE);
+         return;
       }
-   }
 
-   if (doc->elements == NULL)
-   {
-      doc->error = ALI_ERROR_MEMORY_FAILURE;
-      longjmp(doc->environment, ALI_ERROR_MEMORY_FAILURE);
+      /* The new slots have no markup arrays yet. */
+      for (i = doc->elements_size; i < size; i++)
+      {
+         elements[i].markups = NULL;
+         elements[i].markups_size = 0;
+      }
+      doc->elements = elements;
+      doc->elements_size = size;
    }
 
    doc->elements_count++;
@@ -2036,7 +2424,9 @@ new_current_element(
    current_element->data_used = false;
    current_element->data_unavailable = false;
    current_element->new_element = true;
+   current_element->first = 0;
    current_element->count = 0;
+   current_element->live = 0;
    current_element->type_of_last_markup_read = tag_none;
    current_element->last_markup_name = name;
    current_element->last_markup_name_length = name_length;
@@ -2046,11 +2436,13 @@ new_current_element(
    current_element->length = name_length;
    current_element->element_type = element_type;
    current_element->last_markup_read = ali_element_none;
-   current_element->element = doc->next_element;
+   current_element->element = (ali_element_ref) ((doc->next_serial << ali_depth_bits) | (doc->elements_count - 1));
    current_element->start_tag_closed = false;
    current_element->doc = doc;
 
-   doc->next_element = (ali_element_ref) (doc->next_element + 1);
+   /* A serial can only be mistaken for one wrapped around to if a stale ali_element_ref 
+    * is used that many elements later. */
+   doc->next_serial = doc->next_serial < ali_serial_max ? doc->next_serial + 1 : 1;
 }
 
 
@@ -2061,15 +2453,13 @@ find_element(
    ali_element_ref element
    )
 {
-   int16_t i;
+   uint32_t i;
 
 
-   /* Search in reverse order.  Typically elements are LIFO. */
-   for (i = (int16_t) (doc->elements_count - 1); i >= 0; i--)
-   {
-      if (doc->elements[i].element == element)
-         return &doc->elements[i];
-   }
+   /* The depth is in the low bits.  Check the rest in case the element was deleted. */
+   i = (uint32_t) element & (ali_depth_max - 1);
+   if (element > 0 && i < doc->elements_count && doc->elements[i].element == element)
+      return &doc->elements[i];
 
    return NULL;
 }
@@ -2080,7 +2470,6 @@ delete_element(
    ali_element_info ** element  /* the element to delete.  Set to the element's parent for use. */
    )
 {
-   uint16_t elements_to_move;
    uint32_t i;
    ali_element_info * parent;
 
@@ -2097,6 +2486,10 @@ delete_element(
          to close up the markup and be at a good position. */
       skip_content(*element, (*element)->name, (*element)->length);
       skip_end_tag(*element);
+
+      /* Leave it be, the ali_in() is stopping. */
+      if (doc->failed)
+         return;
    }
 
    /* if the parent element's pos isn't advanced as far as this, move it up. */
@@ -2104,19 +2497,12 @@ delete_element(
    if (parent->pos < (*element)->pos)
       parent->pos = (*element)->pos;
 
-   if (i < doc->elements_count)
-   {
-      elements_to_move = (uint16_t) (doc->elements_count - i - 1);
-      if (elements_to_move > 0)
-         memcpy(&doc->elements[i], &doc->elements[i + 1],
-            elements_to_move * sizeof(*doc->elements));
-
-      doc->elements_count--;
-   }
-
    /* Delete the element doc.  We could leave this information around in case it's needed and
     * delete all at the very end.  But removing elements yields better performance and lower
-    * resources. */
+    * resources.  Elements are LIFO, so this is always the last one, and its slot keeps the 
+    * markup array for the next element. */
+   doc->elements_count--;
+
    if (i == 0)
       *element = NULL;
    else
@@ -2192,11 +2578,11 @@ ali_is_element_done(
    if (doc->error != ALI_ERROR_NONE)
       return true;
 
-   if (current_element->count == 0 && !current_element->elements_read)
+   if (current_element->live == 0 && !current_element->elements_read)
       current_element->elements_read = !read_one_markup(current_element);
 
    /* If there is no more markup or it wasn't used by the callback */
-   return current_element->count == 0 || !current_element->data_used;
+   return current_element->live == 0 || !current_element->data_used;
 }
 
 
@@ -2366,7 +2752,8 @@ static void check_byte_order_mark(
     {
         uint32_t byte_order_mark;
         
-        byte_order_mark = *(uint32_t *) doc->text;
+        /* The text may not be aligned, copy rather than cast. */
+        memcpy(&byte_order_mark, doc->text, sizeof(byte_order_mark));
         /* 0x00 0x00 0xFE 0xFF */
         if (byte_order_mark == 0xfeff)
         {
@@ -2386,7 +2773,7 @@ static void check_byte_order_mark(
     {
         uint16_t byte_order_mark;
         
-        byte_order_mark = *(uint16_t *) doc->text;
+        memcpy(&byte_order_mark, doc->text, sizeof(byte_order_mark));
         /* 0xFE 0xFF */
         if (byte_order_mark == 0xfeff)
         {
@@ -2416,149 +2803,314 @@ static void check_byte_order_mark(
 }
                
                
-/*! \brief Open an Ali document for input.
- * 
- * Start input from the file named and return an ali_element_ref needed by all 
- * other Ali functions.  Optionally parse a declaration.
- * 
- * \return A non zero value is a valid ali_element_ref which means the XML document
- * was successfully opened for reading.  Use the ali_element_ref to read from the XML document
- * by passing it to ali_in.  A zero indicates an error opening the document.  Check 
- * stdio's errno to determine the error's cause.
- *
- * \see ali_in, ali_close */
-
-ali_element_ref
-ali_open(
-   ali_doc_info ** new_doc,     /*!< the document to input from */
-   const char *file_name,       /*!< the name of the XML file that the document 
-                                 * inputs data from.  The file may be encoded using
-                                 * UTF-8, ISO-8859-1 or US-ASCII.  The encodings UTF-16
-                                 * and UTF-32 are rejected.  Others will be tried and 
-                                 * should work if they are like C strings (nul terminated). */
-   uint32_t options,            /*!< options for inputing, like expecting xml declarations */
-   void *data                   /*! data passed to callbacks. Usually a pointer to an app
-                                 * structure used to store the document's data. Set 
-                                 * to NULL if your app does not need it. */
-   )
+/* Maps the whole file read only as the document's text.  Nothing is copied and the OS
+ * pages it in as the parse reaches it.  Returns false if the file can't be mapped (it may
+ * be empty, missing, or on a file system without mappings), read_input() then tries. */
+static bool
+map_input(
+   ali_doc_info * doc,
+   const char *file_name)
 {
-   ali_element_ref result = 0;
-   ali_doc_info * doc;
-
-   /* option replaces a Boolean which is sometimes true.  Don't allow that value for a while
-    * until it's probably no longer used. */
-   assert(options != 1);
+#if defined(_WIN32)
+   HANDLE file;
+   HANDLE mapping;
+   LARGE_INTEGER size;
+   void * view = NULL;
+
+   file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+   if (file == INVALID_HANDLE_VALUE)
+      return false;
 
-   /* Check for err */
-   assert(file_name != NULL);
-   assert(new_doc != NULL);
-   doc = *new_doc = (ali_doc_info *) malloc(sizeof(*doc));
-   if (doc != NULL)
+   if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart <= UINT32_MAX)
    {
-      /* needed when the xml declaration is parsed. */
-      if (!setjmp(doc->environment))
+      mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping != NULL)
       {
+         view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+         /* The view keeps the mapping alive. */
+         CloseHandle(mapping);
+      }
+   }
+   CloseHandle(file);
 
-         doc->error = ALI_ERROR_NONE;
-
-         doc->data = data;
-
-         doc->size = 0;
-         doc->text = NULL;
-
-         doc->elements = NULL;
-         doc->elements_size = 0;
-         doc->elements_count = 0;
-
-         doc->options = options;
+   if (view == NULL)
+      return false;
 
+   doc->size = (uint32_t) size.QuadPart;
+#else
+   int fd;
+   struct stat info;
+   void * view = MAP_FAILED;
 
-         fopen_s(&doc->file_in, file_name, "r");
+   fd = open(file_name, O_RDONLY);
+   if (fd < 0)
+      return false;
 
-         if (doc->file_in)
-         {
-            fseek(doc->file_in, 0, SEEK_END);
-            doc->size = ftell(doc->file_in);
-            fseek(doc->file_in, 0, SEEK_SET);
+   if (fstat(fd, &info) == 0 && info.st_size > 0 && (uint64_t) info.st_size <= UINT32_MAX)
+   {
+      view = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+   /* The mapping keeps the file alive. */
+   close(fd);
 
-            if (doc->size > 0)
-            {
-               /* Extra space for a null terminating character is included. 
-                * This design enables safe usage of the standard str* functions, 
-                * but stops memory mapping the file. */
-               doc->text = (ali_char) malloc(doc->size + 1);
-            }
+   if (view == MAP_FAILED)
+      return false;
 
-            if (doc->text != NULL)
-            {
-               int32_t pos = 0;
+   doc->size = (uint32_t) info.st_size;
+#endif
 
-               /* For some reason, fread returns a smaller amount than the filesize. Fix this so null
-                * termination works. */
-               int32_t l = fread((void *) doc->text, sizeof(*doc->text), doc->size, doc->file_in);
+   doc->text = (ali_char) view;
+   doc->source = source_mapped;
+   return true;
+}
 
-               doc->size = l;
-               doc->last_valid_char = &doc->text[doc->size];
-               *(char *) doc->last_valid_char = '\0';
-               doc->current_element = NULL;
 
-               doc->endian = endian_unknown;
-               doc->encoding = encoding_unknown;
+static void
+unmap_input(
+   ali_doc_info * doc)
+{
+#if defined(_WIN32)
+   UnmapViewOfFile((void *) doc->text);
+#else
+   munmap((void *) doc->text, doc->size);
+#endif
+   doc->text = NULL;
+}
 
-               check_byte_order_mark(doc, &pos);
 
-               /* Do this before parsing the XML declaration so the document position can be maintained. */
-               doc->next_element = 2;    /* avoid -1, 0, false, true which can all accidentally happen */
-               new_current_element(doc, 0, &doc->text[pos], 0, &doc->text[pos], 0, tag_none);
+/* Reads the whole file into a malloc'ed copy, for when it can't be mapped.  The copy is
+ * the exact size of the file, it has no terminator either.  Sets doc->error on failure. */
+static bool
+read_input(
+   ali_doc_info * doc,
+   const char *file_name)
+{
+   fopen_s(&doc->file_in, file_name, "rb");
 
-               parse_xml_declaration(doc, doc->current_element);
-               if (doc->error == ALI_ERROR_NOT_XML_DOCUMENT &&
-                  !(options & ALI_OPTION_INPUT_XML_DECLARATION))
-               {
-                  /* The option was not set to require a XML declaration. */
-                  doc->error = ALI_ERROR_NONE;
-               }
+   if (doc->file_in == NULL)
+   {
+      doc->error = ALI_ERROR_FILE_MISSING;
+      return false;
+   }
 
-               if (!encoding_supported(doc->encoding))
-               {
-                  doc->error = ALI_ERROR_ENCODING_UNSUPPORTED;
-               }
+   fseek(doc->file_in, 0, SEEK_END);
+   doc->size = ftell(doc->file_in);
+   fseek(doc->file_in, 0, SEEK_SET);
 
-               if (doc->error == ALI_ERROR_NONE)
-               {
-                  /* Move the element name for the root to after the XML declaration.
-                   * The code to find markups doesn't know how to handle the declaration,
-                   * so just skip it here. */
-                  doc->current_element->name = doc->current_element->pos;
-                  doc->current_element->length = 0;
-                  doc->current_element->last_markup_name = doc->current_element->pos;
-                  doc->current_element->last_markup_name_length = 0;
-               }
-               result = doc->current_element->element;
-            }
-            else if (doc->size == 0)
-               doc->error = ALI_ERROR_NOT_XML_DOCUMENT;
-            else
-               doc->error = ALI_ERROR_MEMORY_FAILURE;
+   if (doc->size > 0)
+   {
+      doc->text = (ali_char) ali_malloc(doc->size);
+   }
 
-            if (doc->file_in != NULL)
-            {
-               fclose(doc->file_in);
-               doc->file_in = NULL;
-            }
-         }
-         else
-            doc->error = ALI_ERROR_FILE_MISSING;
-      }
+   if (doc->text != NULL)
+   {
+      doc->size = fread((void *) doc->text, sizeof(*doc->text), doc->size, doc->file_in);
    }
+   else if (doc->size == 0)
+      doc->error = ALI_ERROR_NOT_XML_DOCUMENT;
+   else
+      doc->error = ALI_ERROR_MEMORY_FAILURE;
 
-   return result;
+   fclose(doc->file_in);
+   doc->file_in = NULL;
+
+   return doc->text != NULL;
 }
 
 
+/* Allocates the document and sets it up for input, with no text yet. */
+static ali_doc_info *
+new_input(
+   ali_doc_info ** new_doc,
+   uint32_t options,
+   void *data)
+{
+   ali_doc_info * doc;
 
+   /* option replaces a Boolean which is sometimes true.  Don't allow that value for a while
+    * until it's probably no longer used. */
+   assert(options != 1);
 
-/*! \brief Close an Ali document.
+   assert(new_doc != NULL);
+   doc = *new_doc = (ali_doc_info *) ali_malloc(sizeof(*doc));
+   if (doc != NULL)
+   {
+      doc->error = ALI_ERROR_NONE;
+
+      doc->data = data;
+
+      doc->size = 0;
+      doc->text = NULL;
+      doc->text_end = NULL;
+      doc->source = source_read;
+      doc->file_in = NULL;
+
+      doc->elements = NULL;
+      doc->elements_size = 0;
+      doc->elements_count = 0;
+
+      doc->queries = NULL;
+      doc->queries_count = 0;
+      doc->queries_next = 0;
+
+      doc->options = options;
+   }
+
+   return doc;
+}
+
+
+/* Starts input once the document has its text: checks the byte order mark, parses the
+ * XML declaration and makes the root element.  Returns the root, or 0 on error. */
+static ali_element_ref
+start_input(
+   ali_doc_info * doc)
+{
+   int32_t pos = 0;
+
+
+   doc->text_end = &doc->text[doc->size];
+   doc->current_element = NULL;
+   doc->failed = false;
+
+   doc->endian = endian_unknown;
+   doc->encoding = encoding_unknown;
+
+   check_byte_order_mark(doc, &pos);
+
+   /* Do this before parsing the XML declaration so the document position can be maintained. */
+   doc->next_serial = 1;     /* avoid -1, 0, false, true which can all accidentally happen */
+   new_current_element(doc, 0, &doc->text[pos], 0, &doc->text[pos], 0, tag_none);
+   if (doc->failed)
+      return 0;
+
+   parse_xml_declaration(doc, doc->current_element);
+   if (doc->failed)
+      return 0;
+   if (doc->error == ALI_ERROR_NOT_XML_DOCUMENT &&
+      !(doc->options & ALI_OPTION_INPUT_XML_DECLARATION))
+   {
+      /* The option was not set to require a XML declaration. */
+      doc->error = ALI_ERROR_NONE;
+   }
+
+   if (!encoding_supported(doc->encoding))
+   {
+      doc->error = ALI_ERROR_ENCODING_UNSUPPORTED;
+   }
+
+   if (doc->error == ALI_ERROR_NONE)
+   {
+      /* Move the element name for the root to after the XML declaration.
+       * The code to find markups doesn't know how to handle the declaration,
+       * so just skip it here. */
+      doc->current_element->name = doc->current_element->pos;
+      doc->current_element->length = 0;
+      doc->current_element->last_markup_name = doc->current_element->pos;
+      doc->current_element->last_markup_name_length = 0;
+   }
+
+   return doc->current_element->element;
+}
+
+
+/*! \brief Open an Ali document for input.
+ * 
+ * Start input from the file named and return an ali_element_ref needed by all 
+ * other Ali functions.  Optionally parse a declaration.
+ * 
+ * The file is memory mapped when possible, and read into memory when not.
+ * 
+ * \return A non zero value is a valid ali_element_ref which means the XML document
+ * was successfully opened for reading.  Use the ali_element_ref to read from the XML document
+ * by passing it to ali_in.  A zero indicates an error opening the document.  Check 
+ * stdio's errno to determine the error's cause.
+ *
+ * \see ali_in, ali_close */
+
+ali_element_ref
+ali_open(
+   ali_doc_info ** new_doc,     /*!< the document to input from */
+   const char *file_name,       /*!< the name of the XML file that the document 
+                                 * inputs data from.  The file may be encoded using
+                                 * UTF-8, ISO-8859-1 or US-ASCII.  The encodings UTF-16
+                                 * and UTF-32 are rejected.  Others will be tried and 
+                                 * should work if they are like C strings. */
+   uint32_t options,            /*!< options for inputing, like expecting xml declarations */
+   void *data                   /*! data passed to callbacks. Usually a pointer to an app
+                                 * structure used to store the document's data. Set 
+                                 * to NULL if your app does not need it. */
+   )
+{
+   ali_element_ref result = 0;
+   ali_doc_info * doc;
+
+   /* Check for err */
+   assert(file_name != NULL);
+
+   doc = new_input(new_doc, options, data);
+   if (doc != NULL && 
+       ((!(options & ALI_OPTION_INPUT_COPY) && map_input(doc, file_name)) || read_input(doc, file_name)))
+   {
+      result = start_input(doc);
+   }
+
+   return result;
+}
+
+
+
+
+/*! \brief Open an Ali document for input from memory.
+ * 
+ * Like ali_open, but the XML document is the size bytes at buffer, such as data 
+ * embedded in the executable or unpacked from an archive.  Nothing is copied.  The 
+ * buffer need not be nul terminated, but it must stay unchanged until ali_close, 
+ * which leaves it to the caller to free.
+ *
+ * \return A non zero value is a valid ali_element_ref which means the XML document
+ * was successfully opened for reading.  A zero indicates an error, see ali_get_error.
+ *
+ * \see ali_open, ali_in, ali_close */
+
+ali_element_ref
+ali_open_memory(
+   ali_doc_info ** new_doc,     /*!< the document to input from */
+   const char *buffer,          /*!< the XML document's text, in the encodings ali_open 
+                                 * accepts. */
+   uint32_t size,               /*!< the number of bytes at buffer */
+   uint32_t options,            /*!< options for inputing, like expecting xml declarations */
+   void *data                   /*! data passed to callbacks. Set to NULL if your app does
+                                 * not need it. */
+   )
+{
+   ali_element_ref result = 0;
+   ali_doc_info * doc;
+
+   doc = new_input(new_doc, options, data);
+   if (doc != NULL)
+   {
+      doc->source = source_memory;
+      if (buffer == NULL || size == 0)
+      {
+         doc->error = ALI_ERROR_NOT_XML_DOCUMENT;
+      }
+      else
+      {
+         doc->text = buffer;
+         doc->size = size;
+         result = start_input(doc);
+      }
+   }
+
+   return result;
+}
+
+
+
+
+/*! \brief Close an Ali document.
  * 
  * Stop input from the Ali document.  Further use of the document is an error.
  * 
@@ -2577,39 +3129,60 @@ ali_close(
     * longer valid. */
    if (doc->elements_size > 0)
    {
-      free(doc->elements);
+      uint16_t i;
+
+      for (i = 0; i < doc->elements_size; i++)
+         ali_free(doc->elements[i].markups);
+      ali_free(doc->elements);
       doc->elements = NULL;
       doc->elements_size = 0;
       doc->elements_count = 0;
    }
 
-   if (doc->text != NULL)
+   ali_free(doc->queries);
+   doc->queries = NULL;
+   doc->queries_count = 0;
+
+   if (doc->text != NULL && doc->source == source_mapped)
+   {
+      unmap_input(doc);
+   }
+   else if (doc->text != NULL && doc->source == source_read)
    {
       memset((void *) doc->text, 0xfe, doc->size);
-      free((void *) doc->text);
+      ali_free((void *) doc->text);
       doc->text = NULL;
    }
    
-   free(doc);
+   ali_free(doc);
 }
 
 
 /* this reads after the input variable for required characters.  These characters must follow the
- * variable read. */
-static void
+ * variable read.  They are stored in the query's text, offset is set to where. */
+static bool
 read_suffix(
-   const char **format,
-   char *suffix_str)
+   ali_query * query,
+   const char *format,
+   uint8_t * offset)
 {
-   const char *formatP = *format;
+   const char *formatP = format;
    char *suffix_end;
+   char *text_end;
 
-   assert(*format != NULL);
-   assert(suffix_str != NULL);
+   assert(format != NULL);
 
-   suffix_end = suffix_str;
+   *offset = query->text_used;
+   suffix_end = &query->text[query->text_used];
+   /* room for the nul */
+   text_end = &query->text[ali_query_max_text - 1];
    while (*formatP != '\0')
    {
+      if (suffix_end >= text_end)
+      {
+         return false;
+      }
+
       if (formatP[0] == '%')
       {
          if (formatP[1] == '%')
@@ -2639,6 +3212,9 @@ read_suffix(
    }
 
    *suffix_end++ = '\0';
+   query->text_used = suffix_end - query->text;
+
+   return true;
 }
 
 
@@ -2697,631 +3273,736 @@ compare_markup_names(
 }
 
 
-static ali_element_ref
-parse_input_format(
-   ali_doc_info * doc,
-   ali_element_ref element,
-   const char *format,
-   va_list arg)
+static ali_query_step *
+add_query_step(
+   ali_query * query,
+   uint8_t type)
+{
+   ali_query_step * step;
+
+   if (query->steps_count >= ali_query_max_steps)
+      return NULL;
+
+   step = &query->steps[query->steps_count++];
+   memset(step, 0, sizeof(*step));
+   step->type = type;
+
+   return step;
+}
+
+
+/* Copies length chars into the query's text, nul terminated, and sets offset to where. */
+static bool
+add_query_text(
+   ali_query * query,
+   const char *chars,
+   int length,
+   uint8_t * offset)
+{
+   if (query->text_used + length + 1 > ali_query_max_text)
+      return false;
+
+   *offset = query->text_used;
+   memcpy(&query->text[query->text_used], chars, length);
+   query->text[query->text_used + length] = '\0';
+   query->text_used += length + 1;
+
+   return true;
+}
+
+
+/* Splits the format into the steps run_query() follows.  This reads the format exactly 
+ * as ali_in always has, it's just done up front.  Returns false if the format is too 
+ * long to fit in a query. */
+static bool
+compile_format(
+   ali_query * query,
+   const char *format)
 {
    const char *f;
-   char prefix_str[32];         /* chars required before input variable */
-   char suffix_str[32];         /* chars required after input variable */
-   char *prefix_end = prefix_str;
-   char *strP;
-   char **strPP;
-   bool element_optional = false;
-   bool element_wanted = false; /* ^e or ^a wants an element */
-   ali_element_ref result = false;
-   int prefix;
-   bool advance_to_content = false;    /* when reading content, 
-                                        * advance to the start of the content 
-                                        * for the markup type.  Set whenever 
-                                        * markup is read, and left unset when
-                                        * content is read successively. */
+   ali_query_step * step;
+   uint32_t unresolved = 0;     /* finds waiting for the step after them to skip to */
+   uint8_t i;
 
 
    /* Check for err */
-   assert(doc != NULL);
+   assert(query != NULL);
    assert(format != NULL);
 
-   /* Init vars. */
-   f = format;
+   query->steps_count = 0;
+   query->text_used = 0;
 
-   /* Look for next format specification */
+   f = format;
    while (*f)
    {
-
       if (*f == '^')
       {
+         bool optional = false;
+
+         /* When markup is not found, what follows it up to the next '^' is skipped. */
+         for (i = 0; unresolved != 0; i++, unresolved >>= 1)
+         {
+            if (unresolved & 1)
+               query->steps[i].skip = query->steps_count;
+         }
+
          f++;
-         element_optional = false;
 
          /* Attributes can be terminated by a '^'. 
           * '^' can be outputted by "^^". */
-
-         /* Support "^e^a%s^a%s^%s^%s" */
          if (*f != '^')
          {
-            advance_to_content = true;
+            step = add_query_step(query, step_close);
+            if (step == NULL)
+               return false;
 
-            /* If closing a current command. */
-            if (doc->current_element->last_markup_read != ali_element_none)
-            {
-               /* Don't close element in "^e^a". */
-               if (!element_wanted)
-               {
-                  /* Done with element */
-                  remove_markup(doc->current_element, doc->current_element->last_markup_read);
-               }
-            }
             /* If not a new command then pop up a level. */
-            else if (*f != 'e' && *f != 'a' && *f != 'o' && *f != '*')
-            {
-               /* Support "^e^a%s^a%s^%s^%s" by closing the element */
-               if (doc->current_element->element != element)
-               {
-                  delete_element(doc, &doc->current_element);
-               }
-               doc->current_element->data_used = true;
-
-               result = true;
-            }
+            step->pop = *f != 'e' && *f != 'a' && *f != 'o' && *f != '*';
 
-            /* Now that it is closed, continue on to the 
-             * format processing. */
+            /* Support "^e^a%s^a%s^%s^%s", the '%' is next. */
             if (*f == '%')
-                continue;
-
+               continue;
          }
 
-
          if (*f == 'o')
          {
-            element_optional = true;
+            optional = true;
             if (*(f + 1) != 0)
                f++;
          }
 
          if (*f == 'e' || *f == 'a' || *f == 'C' || *f == 'P' || *f == '*')
          {
-            ali_element_info *current_element;
-            uint8_t markup_type;
-            int8_t i = 0;
-            bool element_found = false;
-            bool read_prefix = false;
+            step = add_query_step(query, step_find);
+            if (step == NULL)
+               return false;
 
-            if (*f == 'e')
-            {
-               markup_type = tag_element;
-               read_prefix = true;
-            }
-            else if (*f == 'a')
-            {
-               markup_type = tag_attribute;
-               read_prefix = true;
-            }
-            else if (*f == 'C')
-               markup_type = tag_comment;
-            else if (*f == 'P')
-               markup_type = tag_instruction;
+            step->code = *f;
+            step->optional = optional;
 
-            if (read_prefix)
-            {
-               /* namespaces currently are not used.  0 means don't care, and is the only value
-                * allowed. */
-               prefix = va_arg(arg, int);
-               
-               if (prefix != 0)
-               {
-                  /* Make this problem really obvious for now */
-                  doc->error = ALI_ERROR_NAMESPACE_INVALID;
-                  assert(prefix == 0);
-                  return false;
-               }
-            }
+            /* Add a new element structure.  Since this is costly, do not do this for the
+             * common "^e%[sd]" cases.  Do do this for "^e" and "^e%F" and "^e^a%s^%s" */
+            step->enter = f[1] == '\0' || f[1] == '^' || (f[1] == '%' && f[2] == 'F');
+            unresolved |= 1 << (query->steps_count - 1);
+         }
+         else
+         {
+            /* Unrecognized character.  Running the query stops here, so nothing after matters. */
+            if (add_query_step(query, step_invalid) == NULL)
+               return false;
+            break;
+         }
+         f++;
+      }
+      else if (*f == '%')
+      {
+         step = add_query_step(query, step_convert);
+         if (step == NULL)
+            return false;
 
+         f++;                /* skip '%' */
 
-            if (*f != '*' && markup_type != tag_comment)
+         for (;;)
+         {
+            if (*f == 'l')
             {
-               strP = va_arg(arg, char *);
-               if (strP == NULL)
-               {
-                  doc->error = ALI_ERROR_NULL_TAG;
-                  return false;
-               }
+               step->long_arg = true;
             }
-            
-
-            current_element = doc->current_element;
-#ifdef READ_ALL_ELEMENTS
-            if (!current_element->elements_read)
+            else if (*f == 'q' || *f == 'L')
             {
-               read_all_element_tags(current_element);
-               current_element->elements_read = true;
+               step->long_double_arg = true;
             }
-#endif
-            element_wanted = true;
-
-            /* Find the element. Check the next one in the document first. Then
-             * check all already seen and not used.  Then read the document 
-             * until there are no more left in the current element. */
-            if (current_element->count == 0 && !current_element->elements_read)
+            else if (*f == 'h')
             {
-               current_element->elements_read = !read_one_markup(current_element);
+               /* %h reads a short %hh reads a byte */
+               if (!step->long_arg && *(f - 1) == 'h')
+                  step->byte_arg = true;
+               else
+                  step->short_arg = true;
             }
-            for (i = 0; i < current_element->count;)
+            else if (*f == 'a')
             {
-               if (*f == '*' ||
-                  (current_element->markup_type[i] == markup_type &&
-                     (markup_type == tag_comment ||
-	                  compare_markup_names(doc, strP, current_element->markup_name[i], 
-                        current_element->markup_length[i]) == 0)))
-               {
-                  element_found = true;
-                  doc->current_element->last_markup_read = i;
-
-                  /* Add a new element structure.  Since this is costly, do not do this for the
-                   * common "^e%[sd]" cases.  Do do this for "^e" and "^e%F" and "^e^a%s^%s" */
-                  if ((current_element->markup_type[i] == tag_element || *f == '*') &&
-                      (f[1] == '\0' || f[1] == '^' || (f[1] == '%' && f[2] == 'F')))
-                  {
-                     /* Fixup position, which can be off if returning to an element. */
-                     doc->current_element->pos =
-                        &doc->current_element->markup_name[i][doc->current_element->
-                        markup_length[i]];
-
-                     new_current_element(doc, doc->current_element->element, doc->current_element->pos,
-                        doc->current_element->line_number, doc->current_element->markup_name[i],
-                        doc->current_element->markup_length[i], doc->current_element->markup_type[i]);
-
-                     current_element = doc->current_element;
-
-                     result = true;
-                  }
-
-                  /* DOLATER and make ali_get_markup_name() and make ali_get_markup_path() and make 
-                   * ali_get_markup_type() */
-                  break;
-               }
-
-               i++;
-
-               if (i >= current_element->count && !current_element->elements_read)
-               {
-                  current_element->elements_read = !read_one_markup(current_element);
-               }
+               step->allocate = true;
             }
-            if (!element_found)
+            else if ('0' <= *f && *f <= '9')
             {
-               /* find more elements or fail. */
-               current_element->data_unavailable = true;
-
-               /* Not found, report an error if the element is required and this is the first pass
-                * of the parse function. */
-               if (!element_optional && current_element->new_element && *f != '*')
-               {
-                  doc->error = ALI_ERROR_TAG_MISSING;
-                  return false;
-               }
-               else
-               {
-                  /* when the format is "^oe%F" make sure the %F is not attempted */
-                  while (*f != '\0' && *f != '^')
-                     f++;
-
-                  continue;
-               }
+               step->width = step->width * 10 + (*f - '0');
             }
-
-            /* Start collecting the prefix string */
-            prefix_end = prefix_str;
+            else if (*f == 'F' || *f == 's' || *f == 'p' || *f == '%' || *f == '\0' ||
+               *f == 'e' || *f == 'E' || *f == 'f' || *f == 'g' || *f == 'G' ||
+               *f == 'c' || *f == 'd' || *f == 'i' || *f == 'u'  || *f == 'o' || *f == 'x' || *f == 'X')
+            {
+               step->code = *f;
+               break;
+            }
+            f++;
          }
-         else
+
+         if (*f == 's' || *f == 'e' || *f == 'E' || *f == 'f' || *f == 'g' || *f == 'G' ||
+            *f == 'c' || *f == 'd' || *f == 'i' || *f == 'u'  || *f == 'o' || *f == 'x' || *f == 'X')
          {
-            /* Unrecognized character. */
-            doc->error = ALI_ERROR_UNKNOWN_XML_INSTRUCTION;
-            return false;
+            char *scan_end = step->scan_format;
+
+            /* Find the suffix chars. */
+            if (!read_suffix(query, f + 1, &step->text))
+               return false;
+
+            *scan_end++ = '%';
+            if (step->long_double_arg && *f != 'c' && *f != 'd' && *f != 'i' && *f != 'u' && 
+               *f != 'o' && *f != 'x' && *f != 'X')
+               *scan_end++ = 'L';
+            else if (step->long_arg)
+               *scan_end++ = 'l';
+            if (step->short_arg && *f != 'e' && *f != 'E' && *f != 'f' && *f != 'g' && *f != 'G')
+               *scan_end++ = 'h';
+            if (step->byte_arg && *f != 'e' && *f != 'E' && *f != 'f' && *f != 'g' && *f != 'G')
+            {
+               *scan_end++ = 'h';
+               *scan_end++ = 'h';
+            }
+            *scan_end++ = *f;
+            *scan_end++ = '\0';
          }
-         f++;
+
+         /* Skip past the last char passed to fprintf. */
+         if (*f != '\0')
+            f++;
       }
       else
       {
-         if (*f == '%')
-         {
-            bool long_arg = false;
-            bool short_arg = false;
-            bool long_double_arg = false;
-            bool byte_arg = false;
-            ali_element_function *callback;
-            uint32_t width = 0;
-            bool allocate = false;
+         /* chars required before the input */
+         const char *start = f;
 
-            f++;                /* skip '%' */
+         while (*f != '\0' && *f != '^' && *f != '%')
+            f++;
 
-            if (!doc->current_element->start_tag_closed)
-               advance_to_content = true;
+         step = add_query_step(query, step_text);
+         if (step == NULL || !add_query_text(query, start, f - start, &step->text))
+            return false;
+         step->length = f - start;
+      }
+   }
 
-            for (;;)
-            {
-               if (*f == 'l')
-               {
-                  long_arg = true;
-               }
-               else if (*f == 'q' || *f == 'L')
-               {
-                  long_double_arg = true;
-               }
-               else if (*f == 'h')
-               {
-                  /* %h reads a short %hh reads a byte */
-                  if (!long_arg && *(f - 1) == 'h')
-                     byte_arg = true;
-                  else
-                     short_arg = true;
-               }
-               else if (*f == 'a')
-               {
-                  allocate = true;
-               }
-               else if (*f == 'F')
-               {
-                  callback = va_arg(arg, ali_element_function *);
+   for (i = 0; unresolved != 0; i++, unresolved >>= 1)
+   {
+      if (unresolved & 1)
+         query->steps[i].skip = query->steps_count;
+   }
 
-                  if (!doc->current_element->elements_read || !element_wanted)
-                  {
-                     ali_element_ref new_element;
-                     ali_element_info *next;
+   return true;
+}
 
 
-                     new_element = doc->current_element->element;
+/* Inputs data as the query's steps say, see ali_in. */
+static ali_element_ref
+run_query(
+   ali_doc_info * doc,
+   ali_element_ref element,
+   const ali_query * query,
+   va_list arg)
+{
+   const ali_query_step *step;
+   uint8_t s;
+   char prefix_str[ali_query_max_text];  /* chars required before input variable */
+   const char *suffix_str;              /* chars required after input variable */
+   char *prefix_end = prefix_str;
+   char *strP;
+   char **strPP;
+   bool element_optional = false;
+   bool element_wanted = false; /* ^e or ^a wants an element */
+   ali_element_ref result = false;
+   int prefix;
+   bool advance_to_content = false;    /* when reading content, 
+                                        * advance to the start of the content 
+                                        * for the markup type.  Set whenever 
+                                        * markup is read, and left unset when
+                                        * content is read successively. */
 
-                     /* Repeatedly call the callback as long as it uses at least one element. This
-                      * allows it to parse repeated elements until there are no more. */
-                     do
-                     {
-                        if (doc->current_element->element == new_element)
-                        {
-                           doc->current_element->data_used = false;
-                           doc->current_element->data_unavailable = false;
-                        }
 
-                        callback(doc, new_element, doc->data);
+   /* Check for err */
+   assert(doc != NULL);
+   assert(query != NULL);
 
-                        doc->current_element->new_element = false;
-                     }
-                     /* while elements has data to use. */
-                     while (!ali_is_element_done(doc, doc->current_element->element));
-
-                     /* This code skips past the element so that the next markup read does not need 
-                      * to reskip the same data.  Normally reading markup starts at the end of the
-                      * last markup read. */
-                     skip_end_tag(doc->current_element);
-
-                     /* This is a poor determinant of the "parent" element, since there is no data
-                      * tracking this.  When it's wrong, it misses opportunities to skip elements,
-                      * so it's a performance issue. */
-                     if (doc->current_element > doc->elements)
-                        next = doc->current_element - 1;
-                     else
-                        next = NULL;
+   /* Look for next format specification */
+   s = 0;
+   while (s < query->steps_count)
+   {
+      step = &query->steps[s];
 
-                     if (next->pos == &doc->current_element->name[doc->current_element->length])
-                     {
-                        next->pos = doc->current_element->pos;
-                     }
-                     if (next->last_markup_name == doc->current_element->name)
-                     {
-                        next->last_markup_name = doc->current_element->pos;
-                        next->type_of_last_markup_read = tag_none;
-                     }
-                     delete_element(doc, &doc->current_element);
+      if (step->type == step_close)
+      {
+         element_optional = false;
+         advance_to_content = true;
 
+         /* If closing a current command. */
+         if (doc->current_element->last_markup_read != ali_element_none)
+         {
+            /* Don't close element in "^e^a". */
+            if (!element_wanted)
+            {
+               /* Done with element */
+               remove_markup(doc->current_element, doc->current_element->last_markup_read);
+               if (doc->failed)
+                  return false;
+            }
+         }
+         /* If not a new command then pop up a level. */
+         else if (step->pop)
+         {
+            /* Support "^e^a%s^a%s^%s^%s" by closing the element */
+            if (doc->current_element->element != element)
+            {
+               delete_element(doc, &doc->current_element);
+               if (doc->failed)
+                  return false;
+            }
+            doc->current_element->data_used = true;
 
-                     /* Done with element */
-                     doc->current_element->data_used = true;
+            result = true;
+         }
+         s++;
+      }
+      else if (step->type == step_find)
+      {
+         ali_element_info *current_element;
+         uint8_t markup_type;
+         int32_t i = 0;
+         bool element_found = false;
+         bool read_prefix = false;
 
-                     element_wanted = false;
-                     result = true;
-                  }
-                  break;
-               }
-               else if (*f == 's')
-               {
-                  char * content;
+         element_optional = step->optional;
 
-                  if (allocate)
-                      strPP = va_arg(arg, char **);
-                  else
-                      strP = va_arg(arg, char *);
+         if (step->code == 'e')
+         {
+            markup_type = tag_element;
+            read_prefix = true;
+         }
+         else if (step->code == 'a')
+         {
+            markup_type = tag_attribute;
+            read_prefix = true;
+         }
+         else if (step->code == 'C')
+            markup_type = tag_comment;
+         else if (step->code == 'P')
+            markup_type = tag_instruction;
 
-                  /* Do not clear the arg if not used. Otherwise this can clear already read data
-                   * if ali loops because more markup exists. */
+         if (read_prefix)
+         {
+            /* namespaces currently are not used.  0 means don't care, and is the only value
+             * allowed. */
+            prefix = va_arg(arg, int);
+            
+            if (prefix != 0)
+            {
+               /* Make this problem really obvious for now */
+               doc->error = ALI_ERROR_NAMESPACE_INVALID;
+               assert(prefix == 0);
+               return false;
+            }
+         }
 
-                  /* Done finding prefix chars. */
-                  *prefix_end++ = '\0';
 
-                  if (doc->current_element->last_markup_read != ali_element_none || !element_wanted)
-                  {
+         if (step->code != '*' && markup_type != tag_comment)
+         {
+            strP = va_arg(arg, char *);
+            if (strP == NULL)
+            {
+               doc->error = ALI_ERROR_NULL_TAG;
+               return false;
+            }
+         }
+         
 
-                     /* Find the suffix chars. */
-                     f++;
-                     read_suffix(&f, suffix_str);
-                     f--;
+         current_element = doc->current_element;
+#ifdef READ_ALL_ELEMENTS
+         if (!current_element->elements_read)
+         {
+            read_all_element_tags(current_element);
+            current_element->elements_read = true;
+         }
+#endif
+         element_wanted = true;
 
+         /* Find the element. Check the next one in the document first. Then
+          * check all already seen and not used.  Then read the document 
+          * until there are no more left in the current element. */
+         if (current_element->live == 0 && !current_element->elements_read)
+         {
+            current_element->elements_read = !read_one_markup(current_element);
+            if (doc->failed)
+               return false;
+         }
+         for (i = current_element->first; i < current_element->count;)
+         {
+            ali_markup_info *markup = &current_element->markups[i];
 
-                     content =
-                        get_content(doc->current_element,
-                        advance_to_content,
-                        prefix_str,
-                        suffix_str, 
-                        allocate ? NULL : strP, 
-                        width);
-                     if (allocate) 
-                        *strPP = content;
+            if (markup->type != tag_none &&
+               (step->code == '*' ||
+               (markup->type == markup_type &&
+                  (markup_type == tag_comment ||
+                  compare_markup_names(doc, strP, markup->name, markup->length) == 0))))
+            {
+               element_found = true;
+               doc->current_element->last_markup_read = i;
 
-                     if (doc->current_element->last_markup_read != ali_element_none)
-                     {
-                        /* Done with element */
-                        doc->current_element->data_used = true;
-                     }
+               /* Add a new element structure.  Since this is costly, do not do this for the
+                * common "^e%[sd]" cases.  Do do this for "^e" and "^e%F" and "^e^a%s^%s" */
+               if ((markup->type == tag_element || step->code == '*') &&
+                   step->enter)
+               {
+                  /* Fixup position, which can be off if returning to an element. */
+                  doc->current_element->pos = &markup->name[markup->length];
 
-                     element_wanted = false;
-                     result = true;
-                  }
+                  new_current_element(doc, doc->current_element->element, doc->current_element->pos,
+                     doc->current_element->line_number, markup->name,
+                     markup->length, markup->type);
+                  if (doc->failed)
+                     return false;
 
+                  current_element = doc->current_element;
 
-                  break;
+                  result = true;
                }
-               /* %eEfgG */
-               else if (*f == 'e' || *f == 'E' || *f == 'f' || *f == 'g' || *f == 'G')
-               {
-                  char conversion = *f;
-                  char number[32];          /* use stack space for number extraction and conversion. */
-                  char sscanf_format[8];
-                  char *sscanf_format_end;
-                  long double * num_long_double;
-                  double * num_double;
-                  float * num_float;
-
-                  
-                  if (long_double_arg)
-                  {
-                     num_long_double = va_arg(arg, long double *);
-                  }
-                  else if (long_arg)
-                  {
-                     num_double = va_arg(arg, double *);
-                  }
-                  else
-                  {
-                     num_float = va_arg(arg, float *);
-                  }
 
-                  /* Done finding prefix chars. */
-                  *prefix_end++ = '\0';
+               /* DOLATER and make ali_get_markup_name() and make ali_get_markup_path() and make 
+                * ali_get_markup_type() */
+               break;
+            }
 
-                  if (doc->current_element->last_markup_read != ali_element_none || !element_wanted)
-                  {
-                     /* Find the suffix chars. */
-                     f++;
-                     read_suffix(&f, suffix_str);
-                     f--;
-
-
-                     number[0] = '\0';
-                     get_content(doc->current_element,
-                        advance_to_content,
-                        prefix_str, suffix_str, number, 
-                        (width > 0 && width < sizeof(number) - 1) ? width : sizeof(number) - 1);
-
-                     sscanf_format_end = sscanf_format;
-                     *sscanf_format_end++ = '%';
-                     if (long_double_arg)
-                        *sscanf_format_end++ = 'L';
-                     else if (long_arg)
-                        *sscanf_format_end++ = 'l';
-                     *sscanf_format_end++ = conversion;
-                     *sscanf_format_end++ = '\0';
-
-                     /* Handle if not an empty element */
-                     if (number[0] != '\0')
-                     {
-                        if (long_double_arg)
-                           sscanf_s(number, sscanf_format, num_long_double);
-                        else if (long_arg)
-                           sscanf_s(number, sscanf_format, num_double);
-                        else
-                           sscanf_s(number, sscanf_format, num_float);
-                     }
-                     else if (!element_optional && doc->current_element->new_element)
-                     {
-                        /* A valid value was expected for this element and there isn't any, so
-                         * return an error */
-                        doc->error = ALI_ERROR_CONTENT_MISSING;
-                        return false;
-                     }
+            i++;
 
-                     /* Done with element */
-                     doc->current_element->data_used = true;
+            if (i >= current_element->count && !current_element->elements_read)
+            {
+               current_element->elements_read = !read_one_markup(current_element);
+               if (doc->failed)
+                  return false;
+            }
+         }
+         if (!element_found)
+         {
+            /* find more elements or fail. */
+            current_element->data_unavailable = true;
 
-                     element_wanted = false;
-                     result = true;
-                  }
-                  break;
-               }
-               /* %diouXx */
-               else if (*f == 'c' || *f == 'd' || *f == 'i' || *f == 'u'  || *f == 'o' || *f == 'x' || *f == 'X')
-               {
-                  char conversion = *f;
-                  char number[16];          /* use stack space for number extraction and conversion. */
-                  char sscanf_format[8];
-                  char *sscanf_format_end;
-                  long int *num_long;
-                  short int *num_short;
-                  int *num_int;
-                  char *num_char;
-
-                  if (long_arg)
-                  {
-                     num_long = va_arg(arg, long *);
-                  }
-                  else if (short_arg)
-                  {
-                     num_short = va_arg(arg, short *);
-                  }
-                  else if (conversion == 'c' || byte_arg)
-                  {
-                     num_char = va_arg(arg, char *);
+            /* Not found, report an error if the element is required and this is the first pass
+             * of the parse function. */
+            if (!element_optional && current_element->new_element && step->code != '*')
+            {
+               doc->error = ALI_ERROR_TAG_MISSING;
+               return false;
+            }
+            else
+            {
+               /* when the format is "^oe%F" make sure the %F is not attempted */
+               s = step->skip;
+               continue;
+            }
+         }
 
-                     /* limit get_content() to read only one char. */
-                     if (width == 0)
-                        width = 1;
-                  }
-                  else
-                  {
-                     num_int = va_arg(arg, int *);
-                  }
+         /* Start collecting the prefix string */
+         prefix_end = prefix_str;
+         s++;
+      }
+      else if (step->type == step_convert)
+      {
+         uint32_t width = step->width;
+         ali_element_function *callback;
 
-                  /* Done finding prefix chars. */
-                  *prefix_end++ = '\0';
+         if (!doc->current_element->start_tag_closed)
+            advance_to_content = true;
 
-                  if (doc->current_element->last_markup_read != ali_element_none || !element_wanted)
-                  {
-                     /* Find the suffix chars. */
-                     f++;
-                     read_suffix(&f, suffix_str);
-                     f--;
-
-
-                     number[0] = '\0';
-                     get_content(doc->current_element,
-                        advance_to_content,
-                        prefix_str, suffix_str, number, 
-                        (width > 0 && width < sizeof(number) - 1) ? width : sizeof(number) - 1);
-
-                     sscanf_format_end = sscanf_format;
-                     *sscanf_format_end++ = '%';
-                     if (long_arg)
-                        *sscanf_format_end++ = 'l';
-                     if (short_arg)
-                        *sscanf_format_end++ = 'h';
-                     if (byte_arg)
-                     {
-                        *sscanf_format_end++ = 'h';
-                        *sscanf_format_end++ = 'h';
-                     }
-                     *sscanf_format_end++ = conversion;
-                     *sscanf_format_end++ = '\0';
+         suffix_str = &query->text[step->text];
 
-                     /* Handle if not an empty element */
-                     if (number[0] != '\0')
-                     {
-                        if (long_arg)
-                           sscanf_s(number, sscanf_format, num_long);
-                        else if (short_arg)
-                           sscanf_s(number, sscanf_format, num_short);
-                        else if (conversion == 'c' || byte_arg)
-                           sscanf_s(number, sscanf_format, num_char);
-                        else
-                           sscanf_s(number, sscanf_format, num_int);
-                     }
-                     else if (!element_optional && doc->current_element->new_element)
-                     {
-                        /* A valid value was expected for this element and there isn't any, so
-                         * return an error */
-                        doc->error = ALI_ERROR_CONTENT_MISSING;
-                        return false;
-                     }
+         if (step->code == 'F')
+         {
+            callback = va_arg(arg, ali_element_function *);
+
+            if (!doc->current_element->elements_read || !element_wanted)
+            {
+               ali_element_ref new_element;
+               ali_element_info *next;
 
-                     /* Done with element */
-                     doc->current_element->data_used = true;
 
-                     element_wanted = false;
-                     result = true;
+               new_element = doc->current_element->element;
+
+               /* Repeatedly call the callback as long as it uses at least one element. This
+                * allows it to parse repeated elements until there are no more. */
+               do
+               {
+                  if (doc->current_element->element == new_element)
+                  {
+                     doc->current_element->data_used = false;
+                     doc->current_element->data_unavailable = false;
                   }
 
-                  /* sscanf_s it */
-                  break;
+                  callback(doc, new_element, doc->data);
+
+                  doc->current_element->new_element = false;
                }
-               /* return the markup's path */
-               else if (*f == 'p')
-               {
-                  char * content;
+               /* while elements has data to use. */
+               while (!ali_is_element_done(doc, doc->current_element->element));
+
+               /* This code skips past the element so that the next markup read does not need 
+                * to reskip the same data.  Normally reading markup starts at the end of the
+                * last markup read. */
+               if (!doc->failed)
+                  skip_end_tag(doc->current_element);
+               if (doc->failed)
+                  return false;
 
-                  if (allocate)
-                      strPP = va_arg(arg, char **);
-                  else
-                      strP = va_arg(arg, char *);
+               /* This is a poor determinant of the "parent" element, since there is no data
+                * tracking this.  When it's wrong, it misses opportunities to skip elements,
+                * so it's a performance issue. */
+               if (doc->current_element > doc->elements)
+                  next = doc->current_element - 1;
+               else
+                  next = NULL;
 
-                  /* Do not clear the arg if not used. Otherwise this can clear already read data
-                   * if ali loops because more markup exists. */
+               if (next->pos == &doc->current_element->name[doc->current_element->length])
+               {
+                  next->pos = doc->current_element->pos;
+               }
+               if (next->last_markup_name == doc->current_element->name)
+               {
+                  next->last_markup_name = doc->current_element->pos;
+                  next->type_of_last_markup_read = tag_none;
+               }
+               delete_element(doc, &doc->current_element);
+               if (doc->failed)
+                  return false;
 
-                  /* Done finding prefix chars. */
-                  *prefix_end++ = '\0';
 
-                  content = get_element_path(doc, doc->current_element->element);
+               /* Done with element */
+               doc->current_element->data_used = true;
 
-                  if (allocate) 
-                     *strPP = content;
-                  else
-                  {
-                     if (width == 0)
-                        strcpy_s(strP, strlen(strP), content);
-                     else
-                        strncpy_s(strP, strlen(strP), content, width);
+               element_wanted = false;
+               result = true;
+            }
+         }
+         else if (step->code == 's')
+         {
+            char * content;
 
-                     free(content);
-                  }
+            if (step->allocate)
+                strPP = va_arg(arg, char **);
+            else
+                strP = va_arg(arg, char *);
 
-                  element_wanted = false;
-                  result = true;
+            /* Do not clear the arg if not used. Otherwise this can clear already read data
+             * if ali loops because more markup exists. */
 
+            /* Done finding prefix chars. */
+            *prefix_end++ = '\0';
 
-                  break;
+            if (doc->current_element->last_markup_read != ali_element_none || !element_wanted)
+            {
+               content =
+                  get_content(doc->current_element,
+                  advance_to_content,
+                  prefix_str,
+                  suffix_str, 
+                  step->allocate ? NULL : strP, 
+                  width);
+               if (doc->failed)
+                  return false;
+               if (step->allocate) 
+                  *strPP = content;
+
+               if (doc->current_element->last_markup_read != ali_element_none)
+               {
+                  /* Done with element */
+                  doc->current_element->data_used = true;
                }
-               else if ('0' <= *f && *f <= '9')
+
+               element_wanted = false;
+               result = true;
+            }
+         }
+         /* %eEfgG */
+         else if (step->code == 'e' || step->code == 'E' || step->code == 'f' || step->code == 'g' || step->code == 'G')
+         {
+            char number[32];          /* use stack space for number extraction and conversion. */
+            long double * num_long_double;
+            double * num_double;
+            float * num_float;
+
+            
+            if (step->long_double_arg)
+            {
+               num_long_double = va_arg(arg, long double *);
+            }
+            else if (step->long_arg)
+            {
+               num_double = va_arg(arg, double *);
+            }
+            else
+            {
+               num_float = va_arg(arg, float *);
+            }
+
+            /* Done finding prefix chars. */
+            *prefix_end++ = '\0';
+
+            if (doc->current_element->last_markup_read != ali_element_none || !element_wanted)
+            {
+               number[0] = '\0';
+               get_content(doc->current_element,
+                  advance_to_content,
+                  prefix_str, suffix_str, number, 
+                  (width > 0 && width < sizeof(number) - 1) ? width : sizeof(number) - 1);
+               if (doc->failed)
+                  return false;
+
+               /* Handle if not an empty element */
+               if (number[0] != '\0')
                {
-                   width = width * 10 + (*f - '0');
+                  if (step->long_double_arg)
+                     sscanf_s(number, step->scan_format, num_long_double);
+                  else if (step->long_arg)
+                     sscanf_s(number, step->scan_format, num_double);
+                  else
+                     sscanf_s(number, step->scan_format, num_float);
                }
-               else if (*f == '%')
+               else if (!element_optional && doc->current_element->new_element)
                {
-                  /* add the character to those required before the input */
-                  *prefix_end++ = *f;
-                  break;
+                  /* A valid value was expected for this element and there isn't any, so
+                   * return an error */
+                  doc->error = ALI_ERROR_CONTENT_MISSING;
+                  return false;
                }
-               else if (*f == '\0')
+
+               /* Done with element */
+               doc->current_element->data_used = true;
+
+               element_wanted = false;
+               result = true;
+            }
+         }
+         /* %diouXx */
+         else if (step->code == 'c' || step->code == 'd' || step->code == 'i' || step->code == 'u'  || 
+            step->code == 'o' || step->code == 'x' || step->code == 'X')
+         {
+            char number[16];          /* use stack space for number extraction and conversion. */
+            long int *num_long;
+            short int *num_short;
+            int *num_int;
+            char *num_char;
+
+            if (step->long_arg)
+            {
+               num_long = va_arg(arg, long *);
+            }
+            else if (step->short_arg)
+            {
+               num_short = va_arg(arg, short *);
+            }
+            else if (step->code == 'c' || step->byte_arg)
+            {
+               num_char = va_arg(arg, char *);
+
+               /* limit get_content() to read only one char. */
+               if (width == 0)
+                  width = 1;
+            }
+            else
+            {
+               num_int = va_arg(arg, int *);
+            }
+
+            /* Done finding prefix chars. */
+            *prefix_end++ = '\0';
+
+            if (doc->current_element->last_markup_read != ali_element_none || !element_wanted)
+            {
+               number[0] = '\0';
+               get_content(doc->current_element,
+                  advance_to_content,
+                  prefix_str, suffix_str, number, 
+                  (width > 0 && width < sizeof(number) - 1) ? width : sizeof(number) - 1);
+               if (doc->failed)
+                  return false;
+
+               /* Handle if not an empty element */
+               if (number[0] != '\0')
                {
-                  /* This is an abrupt end. 
-                   * add the character to those required before the input */
-                  *prefix_end++ = *f;
-                  break;
+                  if (step->long_arg)
+                     sscanf_s(number, step->scan_format, num_long);
+                  else if (step->short_arg)
+                     sscanf_s(number, step->scan_format, num_short);
+                  else if (step->code == 'c' || step->byte_arg)
+                     sscanf_s(number, step->scan_format, num_char);
+                  else
+                     sscanf_s(number, step->scan_format, num_int);
                }
-               else
+               else if (!element_optional && doc->current_element->new_element)
                {
+                  /* A valid value was expected for this element and there isn't any, so
+                   * return an error */
+                  doc->error = ALI_ERROR_CONTENT_MISSING;
+                  return false;
                }
-               f++;
+
+               /* Done with element */
+               doc->current_element->data_used = true;
+
+               element_wanted = false;
+               result = true;
             }
-            
-            prefix_end = prefix_str;
+         }
+         /* return the markup's path */
+         else if (step->code == 'p')
+         {
+            char * content;
 
+            if (step->allocate)
+                strPP = va_arg(arg, char **);
+            else
+                strP = va_arg(arg, char *);
 
-            if (*f != 'p')
-               advance_to_content = false;
+            /* Do not clear the arg if not used. Otherwise this can clear already read data
+             * if ali loops because more markup exists. */
 
-            /* Skip past the last char passed to fprintf. */
-            if (*f != '\0')
-               f++;
+            /* Done finding prefix chars. */
+            *prefix_end++ = '\0';
 
+            content = get_element_path(doc, doc->current_element->element);
+
+            if (step->allocate) 
+               *strPP = content;
+            else
+            {
+               if (width == 0)
+                  strcpy_s(strP, strlen(strP), content);
+               else
+                  strncpy_s(strP, strlen(strP), content, width);
+
+               free(content);
+            }
+
+            element_wanted = false;
+            result = true;
          }
-         else
-         {
-            /* add the character to those required before the input */
-            *prefix_end++ = *f++;
-         }
-      }
+         
+         prefix_end = prefix_str;
 
+         if (step->code != 'p')
+            advance_to_content = false;
 
+         s++;
+      }
+      else if (step->type == step_text)
+      {
+         /* add the characters to those required before the input */
+         memcpy(prefix_end, &query->text[step->text], step->length);
+         prefix_end += step->length;
+         s++;
+      }
+      else
+      {
+         /* Unrecognized character. */
+         doc->error = ALI_ERROR_UNKNOWN_XML_INSTRUCTION;
+         return false;
+      }
    }
 
    /* If closing a current command. */
@@ -3330,6 +4011,8 @@ parse_input_format(
    {
       /* Done with element */
       remove_markup(doc->current_element, doc->current_element->last_markup_read);
+      if (doc->failed)
+         return false;
    }
 
    if (result)
@@ -3338,16 +4021,63 @@ parse_input_format(
    return result;
 }
 
-/*! \brief Input some XML formatted data.
- * 
- * Input data from doc at element according to the format 
- * specified.  The format is a C string containing text, XML 
- * instructions to read XML structures, and scanf like 
- * rules to input the document text and save in the arguments.
- * 
- * Text is input as is, except the XML entities for &<>\" are converted.
- * 
- * The syntax of an XML instruction is:
+
+/* The part of ali_in and ali_in_query after the arguments are in hand. */
+static ali_element_ref
+in_query(
+   ali_doc_info * doc,
+   ali_element_ref element,
+   const ali_query * query,
+   va_list args)
+{
+   ali_element_ref result = false;
+
+
+   if (doc->error == ALI_ERROR_NONE)
+   {
+       /* The error could have been cleared by ali_set_error(). */
+       doc->failed = false;
+
+       /* Search for the element specified. */
+       if (doc->current_element->element != element)
+       {
+
+           ali_element_info *found = find_element(doc, element);
+
+           if (found != NULL)
+           {
+              while (doc->current_element != found && !doc->failed)
+              {
+                 delete_element(doc, &doc->current_element);
+              }
+           }
+       }
+       
+       if (doc->current_element == NULL || doc->failed)
+       {
+           /* DOLATER error if invalid element? (element != 0) */
+           return false;
+           
+       }
+       
+       
+       result = run_query(doc, element, query, args);
+   }
+
+   return result;
+}
+
+
+/*! \brief Input some XML formatted data.
+ * 
+ * Input data from doc at element according to the format 
+ * specified.  The format is a C string containing text, XML 
+ * instructions to read XML structures, and scanf like 
+ * rules to input the document text and save in the arguments.
+ * 
+ * Text is input as is, except the XML entities for &<>\" are converted.
+ * 
+ * The syntax of an XML instruction is:
  * 
  * 
  * format is a string that consists of a repeatable set that 
@@ -3404,6 +4134,57 @@ parse_input_format(
  * 
  * \see ali_open, ali_close, ali_is_element_new, ali_get_error */
 
+/* The compiled format for ali_in, from the document's cache or compiled into it.  A 
+ * format too long to keep, or one met when there's no memory for the cache, is compiled 
+ * into scratch instead.  Returns NULL if the format can't be compiled. */
+static const ali_query *
+find_query(
+   ali_doc_info * doc,
+   const char *format,
+   ali_query * scratch)
+{
+   ali_cached_query * entry;
+   size_t length;
+   int i;
+
+
+   for (i = 0; i < doc->queries_count; i++)
+   {
+      entry = &doc->queries[i];
+      if (entry->format == format && strcmp(entry->format_text, format) == 0)
+         return &entry->query;
+   }
+
+   length = strlen(format);
+   if (length < ali_query_max_format && doc->queries == NULL)
+   {
+      doc->queries = (ali_cached_query *) ali_malloc(ALI_CONFIG_QUERY_CACHE_SIZE * sizeof(*doc->queries));
+   }
+   if (length >= ali_query_max_format || doc->queries == NULL)
+      return compile_format(scratch, format) ? scratch : NULL;
+
+   if (doc->queries_count < ALI_CONFIG_QUERY_CACHE_SIZE)
+   {
+      entry = &doc->queries[doc->queries_count++];
+   }
+   else
+   {
+      entry = &doc->queries[doc->queries_next];
+      doc->queries_next = (doc->queries_next + 1) % ALI_CONFIG_QUERY_CACHE_SIZE;
+   }
+
+   if (!compile_format(&entry->query, format))
+   {
+      /* Nothing matches it until it's reused. */
+      entry->format = NULL;
+      return NULL;
+   }
+   entry->format = format;
+   memcpy(entry->format_text, format, length + 1);
+   return &entry->query;
+}
+
+
 ali_element_ref
 ali_in(
    ali_doc_info * doc,          /*!< the document to input from */
@@ -3413,6 +4194,8 @@ ali_in(
    ...)
 {
    va_list args;
+   ali_query scratch;
+   const ali_query * query;
    ali_element_ref result = false;
 
 
@@ -3423,41 +4206,977 @@ ali_in(
 
    if (doc->error == ALI_ERROR_NONE)
    {
-       /* Search for the element specified. */
-       if (doc->current_element->element != element)
+       query = find_query(doc, format, &scratch);
+       if (query == NULL)
        {
-
-           if (find_element(doc, element) != NULL)
-           {
-              while (element < doc->current_element->element)
-              {
-                 delete_element(doc, &doc->current_element);
-              }
-
-              assert(doc->current_element->element == element);
-           }
-       }
-       
-       if (doc->current_element == NULL)
-       {
-           /* DOLATER error if invalid element? (element != 0) */
+           doc->error = ALI_ERROR_UNKNOWN_XML_INSTRUCTION;
            return false;
-           
-       }
-       
-       
-       if (!setjmp(doc->environment))
-       {
-           va_start(args, format);
-           result = parse_input_format(doc, element, format, args);
-           va_end(args);
        }
+
+       va_start(args, format);
+       result = in_query(doc, element, query, args);
+       va_end(args);
+   }
+
+   return result;
+}
+
+
+/*! \brief Compile a format for repeated input.
+ * 
+ * Reads the format, as described for ali_in, once into the steps ali_in_query follows.
+ * A format used for every element of a long list then costs nothing to read after the
+ * first time.  The query is not tied to a document, it can be used with any.
+ *
+ * \return The compiled query, to be freed with ali_free_query, or NULL if the format
+ * is too long or memory ran out.
+ * 
+ * \see ali_in_query, ali_free_query */
+
+ali_query *
+ali_compile(
+   const char *format           /*!< C string containing the text and XML instructions to input. */
+   )
+{
+   ali_query * query;
+
+
+   /* Check for err */
+   assert(format != NULL);
+
+   query = (ali_query *) ali_malloc(sizeof(*query));
+   if (query != NULL && !compile_format(query, format))
+   {
+      ali_free(query);
+      query = NULL;
+   }
+
+   return query;
+}
+
+
+/*! \brief Free a query made by ali_compile.
+ * 
+ * \see ali_compile */
+
+void
+ali_free_query(
+   ali_query * query            /*!< the query to free, may be NULL */
+   )
+{
+   ali_free(query);
+}
+
+
+/*! \brief Input some XML formatted data with a compiled format.
+ * 
+ * The same as ali_in, but the format was compiled by ali_compile.  The arguments 
+ * are the ones the format takes with ali_in.
+ * 
+ * \return The ali_element_ref of the element being read, or 0.
+ * 
+ * \see ali_compile, ali_in */
+
+ali_element_ref
+ali_in_query(
+   ali_doc_info * doc,          /*!< the document to input from */
+   ali_element_ref element,     /*!< which XML element in the document to input from */
+   const ali_query * query,     /*!< the compiled format.  This indicates how to interpret 
+                                 * all following arguments. */
+   ...)
+{
+   va_list args;
+   ali_element_ref result;
+
+
+   /* Check for err */
+   assert(doc != NULL);
+   assert(query != NULL);
+   assert(element != 1);        /* Invalid element ref */
+
+   va_start(args, query);
+   result = in_query(doc, element, query, args);
+   va_end(args);
+
+   return result;
+}
+
+
+/*! \brief Skip the rest of an element and get its text.
+ * 
+ * Closes element, which must have been entered by "^e" and still be open, 
+ * reading past its content and end tag.  text and size are set to the whole 
+ * element as it is in the input, from its start tag through its end tag.  This 
+ * is a complete XML document, without the XML declaration, that ali_open_memory 
+ * can read.  It lets large independent elements be found with one fast pass over 
+ * the document and then read separately, for example on several threads.
+ * 
+ * The text is part of doc's input and stays valid until ali_close.  The element's 
+ * parent carries on after the element, as if it had been read with ali_in.
+ * 
+ * \return true if the element was skipped, false on error.
+ * 
+ * \see ali_in, ali_open_memory */
+
+bool
+ali_skip(
+   ali_doc_info * doc,          /*!< the document to input from */
+   ali_element_ref element,     /*!< the element to skip */
+   const char **text,           /*!< set to the first char of the element's start tag */
+   uint32_t *size)              /*!< set to the number of chars through its end tag */
+{
+   ali_element_info *found;
+   ali_element_info *parent;
+
+
+   /* Check for err */
+   assert(doc != NULL);
+   assert(text != NULL);
+   assert(size != NULL);
+
+   if (doc->error != ALI_ERROR_NONE)
+      return false;
+
+   /* The error could have been cleared by ali_set_error(). */
+   doc->failed = false;
+
+   found = find_element(doc, element);
+   if (found == NULL || found->element_type != tag_element)
+   {
+      doc->error = ALI_ERROR_ELEMENT_INVALID;
+      return false;
+   }
+
+   /* Close the elements opened inside it. */
+   while (doc->current_element != found && !doc->failed)
+      delete_element(doc, &doc->current_element);
+
+   if (!doc->failed)
+   {
+      skip_content(found, found->name, found->length);
+      skip_end_tag(found);
+   }
+   if (doc->failed)
+      return false;
+
+   /* The parent carries on after the end tag, and doesn't skip the element again 
+    * when it's done with the markup it was entered from.  The same as after "^e%F". */
+   parent = found - 1;
+   if (parent->pos < found->pos)
+      parent->pos = found->pos;
+   if (parent->last_markup_name == found->name)
+   {
+      parent->last_markup_name = found->pos;
+      parent->type_of_last_markup_read = tag_none;
+   }
+   parent->data_used = true;
+
+   /* Elements are LIFO, so this is the last one. */
+   doc->elements_count--;
+   doc->current_element = parent;
+
+   *text = found->name - 1;     /* the '<' */
+   *size = (uint32_t) (found->pos - *text);
+
+   return true;
+}
+
+
+/* Reads the name of a start tag, end tag or attribute for ali_parse, up to the whitespace, 
+ * '=', '/' or '>' after it.  This is looser than skip_element_tag, the chars aren't checked. */
+static ali_text
+read_name(
+   ali_element_info * element)
+{
+   ali_text name;
+   uint8_t safe_c;
+
+
+   name.text = element->pos;
+   safe_c = deref(element->doc, element->pos);
+   while (safe_c != '\0' && safe_c != ' ' && safe_c != '\t' && safe_c != 0x0a && safe_c != 0x0d &&
+      safe_c != '=' && safe_c != '/' && safe_c != '>')
+   {
+      element->pos++;
+      safe_c = deref(element->doc, element->pos);
+   }
+   name.size = (uint32_t) (element->pos - name.text);
+
+   if (safe_c == '\0')
+      fail(element->doc, ALI_ERROR_DATA_INCOMPLETE);
+   else if (name.size == 0)
+      fail(element->doc, ALI_ERROR_TAG_INVALID);
+
+   return name;
+}
+
+
+/* Checks for c at element->pos and skips it.  The markup is invalid without it. */
+static void
+expect_char(
+   ali_element_info * element,
+   char c)
+{
+   uint8_t safe_c;
+
+
+   safe_c = deref(element->doc, element->pos);
+   if (safe_c == (uint8_t) c)
+      element->pos++;
+   else if (safe_c == '\0')
+      fail(element->doc, ALI_ERROR_DATA_INCOMPLETE);
+   else
+      fail(element->doc, ALI_ERROR_TAG_INVALID);
+}
+
+
+/* Checks that nothing was read from doc yet, so read_events can start at the 
+ * root's position. */
+static bool
+start_events(
+   ali_doc_info * doc)
+{
+   ali_element_info *root;
+
+
+   if (doc->error != ALI_ERROR_NONE)
+      return false;
+
+   /* The error could have been cleared by ali_set_error(). */
+   doc->failed = false;
+
+   root = &doc->elements[0];
+   if (doc->elements_count != 1 || doc->current_element != root || 
+      root->live != 0 || root->type_of_last_markup_read != tag_none || root->elements_read)
+   {
+      doc->error = ALI_ERROR_ELEMENT_INVALID;
+      return false;
+   }
+
+   return true;
+}
+
+
+/* The reading for ali_parse and ali_dom_build.  Calls handler's functions with data, 
+ * starting from the root's position. */
+static bool
+read_events(
+   ali_doc_info * doc,
+   const ali_handler * handler,
+   void *data)
+{
+   ali_element_info *root = &doc->elements[0];
+   ali_text *open = NULL;       /* names of the elements not ended yet */
+   uint32_t open_size = 0;
+   uint32_t depth = 0;
+   ali_char start;
+   ali_text name;
+   ali_text value;
+   uint8_t safe_c;
+   uint8_t next_c;
+
+
+   while (doc->error == ALI_ERROR_NONE)
+   {
+      /* content, up to the next markup */
+      start = root->pos;
+      root->pos = scan_to(root->pos, doc->text_end, "<");
+      if (root->pos != start && depth > 0 && handler->content != NULL)
+      {
+         value.text = start;
+         value.size = (uint32_t) (root->pos - start);
+         handler->content(doc, value, data);
+         if (doc->error != ALI_ERROR_NONE)
+            break;
+      }
+
+      /* The end of the input, or a NUL, which ends it for Ali. */
+      if (deref(doc, root->pos) != '<')
+         break;
+
+      next_c = deref(doc, root->pos + 1);
+      if (next_c == '/')
+      {
+         /* http://www.w3.org/TR/REC-xml#NT-ETag */
+         root->pos += 2;
+         name = read_name(root);
+         skip_whitespace(root);
+         if (!doc->failed)
+            expect_char(root, '>');
+         if (doc->failed)
+            break;
+         if (depth == 0 || open[depth - 1].size != name.size ||
+            memcmp(open[depth - 1].text, name.text, name.size) != 0)
+         {
+            fail(doc, ALI_ERROR_TAG_INVALID);
+            break;
+         }
+         depth--;
+         if (handler->end_element != NULL)
+            handler->end_element(doc, name, data);
+      }
+      else if (next_c == '!')
+      {
+         if (input_matches(doc, root->pos, "<!--", 4))
+         {
+            /* http://www.w3.org/TR/REC-xml#NT-Comment */
+            root->pos += 4;
+            skip_to_end_of_comment(root);
+         }
+         else if (depth > 0 && input_matches(doc, root->pos, "<![CDATA[", 9))
+         {
+            /* http://www.w3.org/TR/REC-xml#NT-CDSect */
+            start = root->pos;
+            root->pos += 9;
+            do
+            {
+               root->pos = scan_to(root->pos, doc->text_end, "]");
+               safe_c = deref(doc, root->pos);
+               if (safe_c == ']' && input_matches(doc, root->pos, "]]>", 3))
+                  break;
+               root->pos++;
+            }
+            while (safe_c != '\0');
+            if (safe_c == '\0')
+            {
+               fail(doc, ALI_ERROR_DATA_INCOMPLETE);
+               break;
+            }
+            root->pos += 3;
+            if (handler->content != NULL)
+            {
+               value.text = start;
+               value.size = (uint32_t) (root->pos - start);
+               handler->content(doc, value, data);
+            }
+         }
+         else if (depth == 0 && skip_dtd(root))
+         {
+            root->pos++;        /* skip '>' */
+         }
+         else
+         {
+            fail(doc, ALI_ERROR_TAG_INVALID);
+            break;
+         }
+         if (root->pos > doc->text_end)
+            fail(doc, ALI_ERROR_DATA_INCOMPLETE);
+      }
+      else if (next_c == '?')
+      {
+         /* http://www.w3.org/TR/REC-xml#NT-PI */
+         root->pos += 2;
+         skip_to_end_of_processing_instruction(root);
+         if (root->pos > doc->text_end)
+            fail(doc, ALI_ERROR_DATA_INCOMPLETE);
+      }
+      else
+      {
+         /* http://www.w3.org/TR/REC-xml#NT-STag */
+         root->pos++;
+         name = read_name(root);
+         if (doc->failed)
+            break;
+         if (handler->start_element != NULL)
+            handler->start_element(doc, name, data);
+
+         /* http://www.w3.org/TR/REC-xml#NT-Attribute */
+         while (doc->error == ALI_ERROR_NONE)
+         {
+            skip_whitespace(root);
+            safe_c = deref(doc, root->pos);
+            if (safe_c == '/' && deref(doc, root->pos + 1) == '>')
+            {
+               /* http://www.w3.org/TR/REC-xml#NT-EmptyElemTag */
+               root->pos += 2;
+               if (handler->end_element != NULL)
+                  handler->end_element(doc, name, data);
+               break;
+            }
+            if (safe_c == '>')
+            {
+               root->pos++;
+               if (depth >= open_size)
+               {
+                  ali_text *names;
+                  uint32_t size = open_size == 0 ? ALI_CONFIG_DEFAULT_NESTED_ELEMENT_COUNT : open_size * 2;
+
+                  names = (ali_text *) ali_realloc(open, size * sizeof(*names));
+                  if (names == NULL)
+                  {
+                     fail(doc, ALI_ERROR_MEMORY_FAILURE);
+                     break;
+                  }
+                  open = names;
+                  open_size = size;
+               }
+               open[depth++] = name;
+               break;
+            }
+
+            value = read_name(root);    /* the attribute's name */
+            skip_whitespace(root);
+            if (!doc->failed)
+               expect_char(root, '=');
+            skip_whitespace(root);
+            safe_c = deref(doc, root->pos);
+            if (!doc->failed && safe_c != '"' && safe_c != '\'')
+               fail(doc, safe_c == '\0' ? ALI_ERROR_DATA_INCOMPLETE : ALI_ERROR_TAG_INVALID);
+            if (doc->failed)
+               break;
+
+            {
+               ali_text attribute = value;
+               char stops[2];
+
+               stops[0] = (char) safe_c;
+               stops[1] = '\0';
+               value.text = ++root->pos;
+               root->pos = scan_to(root->pos, doc->text_end, stops);
+               value.size = (uint32_t) (root->pos - value.text);
+               expect_char(root, (char) safe_c);
+               if (doc->failed)
+                  break;
+               if (handler->attribute != NULL)
+                  handler->attribute(doc, attribute, value, data);
+            }
+         }
+      }
    }
 
+   /* Elements still open at the end of the input. */
+   if (doc->error == ALI_ERROR_NONE && depth > 0)
+      fail(doc, ALI_ERROR_DATA_INCOMPLETE);
+
+   ali_free(open);
+
+   return doc->error == ALI_ERROR_NONE;
+}
+
+
+/*! \brief Read a whole document, calling the handler for each part of it.
+ * 
+ * This is the streaming way to read a document, instead of ali_in.  The document 
+ * is read once, in order, and the handler's functions are called as its parts are 
+ * found.  Any function can be NULL to ignore that part.
+ * - start_element for each start tag, then attribute for each of its attributes.
+ * - content for the text between markup inside elements.  It can come in several 
+ *   pieces, and CDATA sections are passed with their markup.
+ * - end_element when the element ends.  An empty element ends right after its 
+ *   attributes.
+ * 
+ * Names and values are ali_text views of the input, nothing is copied and nothing 
+ * is allocated per element or attribute.  They are as written, with entities and 
+ * CDATA sections left in, use ali_decode to get the text as ali_in would give it. 
+ * Comments, processing instructions and the DTD are skipped.
+ * 
+ * The only memory used while reading is the list of open elements, so with a 
+ * mapped file it doesn't grow with the file's size.  Call ali_parse right after 
+ * ali_open, the document can't also be read with ali_in.  A handler function stops 
+ * the parse by setting an error with ali_set_error.
+ * 
+ * \return true if the whole document was read, else check ali_get_error.
+ * 
+ * \see ali_open, ali_decode */
+
+bool
+ali_parse(
+   ali_doc_info * doc,          /*!< the document to input from, just opened */
+   const ali_handler * handler) /*!< the functions to call.  They are passed the data 
+                                 * given to ali_open. */
+{
+   bool result;
+
+
+   /* Check for err */
+   assert(doc != NULL);
+   assert(handler != NULL);
+
+   if (!start_events(doc))
+      return false;
+
+   result = read_events(doc, handler, doc->data);
+
+   /* There is nothing left for ali_in. */
+   doc->elements[0].elements_read = true;
+
    return result;
 }
 
 
+/*! \brief Decode text passed by ali_parse.
+ * 
+ * Converts entities and CDATA sections and normalizes line ends the way ali_in does 
+ * for content, storing the result in dest with a terminating NUL.  Text that doesn't 
+ * fit is cut off.
+ * 
+ * \return The number of chars stored, without the NUL.
+ * 
+ * \see ali_parse */
+
+uint32_t
+ali_decode(
+   ali_doc_info * doc,          /*!< the document the text is from */
+   ali_text text,               /*!< a name, value or content passed to the handler */
+   char *dest,                  /*!< where to store the decoded text */
+   uint32_t dest_size)          /*!< the size of dest, including the NUL */
+{
+   /* Check for err */
+   assert(doc != NULL);
+   assert(dest != NULL);
+   assert(dest_size > 0);
+
+   /* decode_string takes a size of 0 as no limit. */
+   if (text.size == 0 || dest_size < 2)
+   {
+      *dest = '\0';
+      return 0;
+   }
+
+   if (decode_string(doc, NULL, true, text.text, text.text + text.size - 1, dest, dest_size - 1) == NULL)
+   {
+      *dest = '\0';
+      return 0;
+   }
+
+   return (uint32_t) strlen(dest);
+}
+
+
+/* A node of a DOM made by ali_dom_build.  Text is stored as offsets into the input, 
+ * so the DOM is a fixed size and holds no pointers. */
+typedef struct
+{
+   uint32_t name;
+   uint32_t name_size;
+   /* The text between the start and end tags.  While building, content is where 
+    * the start tag has been read to, until the end tag is found. */
+   uint32_t content;
+   uint32_t content_size;
+   uint32_t first_attribute;
+   uint32_t attributes;
+   ali_node_ref parent;
+   ali_node_ref first_child;
+   ali_node_ref next;       /* the next sibling */
+} dom_node;
+
+typedef struct
+{
+   uint32_t name;
+   uint32_t name_size;
+   uint32_t value;
+   uint32_t value_size;
+} dom_attribute;
+
+/* The nodes and attributes follow this in the same block.  Node refs count 
+ * from 1, the document node, so 0 can mean none like an ali_element_ref. */
+struct ali_dom
+{
+   ali_doc_info *doc;
+   uint32_t nodes_count;
+   uint32_t attributes_count;
+   dom_node *nodes;
+   dom_attribute *attributes;
+   ali_node_ref current;        /* building: the element being read */
+   ali_node_ref previous;       /* building: the last element ended */
+};
+
+#define dom_node_at(dom, node) (&(dom)->nodes[(node) - 1])
+
+
+/* The first pass of ali_dom_build only counts. */
+static void
+count_dom_element(
+   ali_doc_info * doc,
+   ali_text name,
+   void *data)
+{
+   (void) doc;
+   (void) name;
+   ((ali_dom *) data)->nodes_count++;
+}
+
+static void
+count_dom_attribute(
+   ali_doc_info * doc,
+   ali_text name,
+   ali_text value,
+   void *data)
+{
+   (void) doc;
+   (void) name;
+   (void) value;
+   ((ali_dom *) data)->attributes_count++;
+}
+
+
+/* The second pass fills in the nodes. */
+static void
+add_dom_element(
+   ali_doc_info * doc,
+   ali_text name,
+   void *data)
+{
+   ali_dom *dom = (ali_dom *) data;
+   ali_node_ref node = (ali_node_ref) ++dom->nodes_count;
+   dom_node *n = dom_node_at(dom, node);
+
+
+   n->name = (uint32_t) (name.text - doc->text);
+   n->name_size = name.size;
+   n->content = n->name + name.size;
+   n->content_size = 0;
+   n->first_attribute = dom->attributes_count;
+   n->attributes = 0;
+   n->parent = dom->current;
+   n->first_child = 0;
+   n->next = 0;
+
+   /* Only the current element's children end while it's current, so the last 
+    * element ended is the previous sibling if it has the same parent. */
+   if (dom->previous != 0 && dom_node_at(dom, dom->previous)->parent == dom->current)
+      dom_node_at(dom, dom->previous)->next = node;
+   else
+      dom_node_at(dom, dom->current)->first_child = node;
+
+   dom->current = node;
+}
+
+static void
+add_dom_attribute(
+   ali_doc_info * doc,
+   ali_text name,
+   ali_text value,
+   void *data)
+{
+   ali_dom *dom = (ali_dom *) data;
+   dom_node *n = dom_node_at(dom, dom->current);
+   dom_attribute *a = &dom->attributes[dom->attributes_count++];
+
+
+   a->name = (uint32_t) (name.text - doc->text);
+   a->name_size = name.size;
+   a->value = (uint32_t) (value.text - doc->text);
+   a->value_size = value.size;
+   n->attributes++;
+   n->content = a->value + value.size + 1;      /* after the quote */
+}
+
+static void
+end_dom_element(
+   ali_doc_info * doc,
+   ali_text name,
+   void *data)
+{
+   ali_dom *dom = (ali_dom *) data;
+   dom_node *n = dom_node_at(dom, dom->current);
+
+
+   /* An empty element ends with its start tag's name, and has no content. */
+   if (name.text != doc->text + n->name)
+   {
+      n->content = (uint32_t) (scan_to(doc->text + n->content, doc->text_end, ">") + 1 - doc->text);
+      n->content_size = (uint32_t) (name.text - 2 - doc->text) - n->content;    /* before "</" */
+   }
+
+   dom->previous = dom->current;
+   dom->current = n->parent;
+}
+
+
+/* Is the text at offset in the input the same as name? */
+static bool
+same_text(
+   const ali_dom * dom,
+   uint32_t offset,
+   uint32_t size,
+   const char *name)
+{
+   return strlen(name) == size && memcmp(dom->doc->text + offset, name, size) == 0;
+}
+
+
+/*! \brief Read a whole document into memory for random access.
+ * 
+ * ali_in reads in document order, and markup read out of order costs memory and 
+ * rescanning.  When the order is not known, ali_dom_build reads the document once, 
+ * like ali_parse, into a DOM of elements and attributes that can then be read in 
+ * any order with ali_dom_child, ali_dom_next and ali_dom_attribute.  Each of them 
+ * is a direct lookup, apart from comparing names.
+ * 
+ * The DOM is one block of memory, sized by a first pass that counts the elements 
+ * and attributes, and freed with ali_dom_free.  It stores offsets into the input 
+ * rather than copies, so the document must stay open while the DOM is used.  Call 
+ * it right after ali_open, the document can't also be read with ali_in.
+ * 
+ * \return The DOM, or NULL on error.  Check ali_get_error.
+ * 
+ * \see ali_open, ali_dom_free, ali_parse */
+
+ali_dom *
+ali_dom_build(
+   ali_doc_info * doc)          /*!< the document to input from, just opened */
+{
+   ali_handler handler;
+   ali_dom counts;
+   ali_dom *dom;
+   ali_char start;
+   dom_node *n;
+
+
+   /* Check for err */
+   assert(doc != NULL);
+
+   if (!start_events(doc))
+      return NULL;
+
+   /* Count, then read again into a block of the right size. */
+   start = doc->elements[0].pos;
+   counts.nodes_count = 0;
+   counts.attributes_count = 0;
+   handler.start_element = count_dom_element;
+   handler.attribute = count_dom_attribute;
+   handler.content = NULL;
+   handler.end_element = NULL;
+   if (!read_events(doc, &handler, &counts))
+      return NULL;
+
+   dom = (ali_dom *) ali_malloc(sizeof(*dom) + 
+      (counts.nodes_count + 1) * sizeof(dom_node) + 
+      counts.attributes_count * sizeof(dom_attribute));
+   if (dom == NULL)
+   {
+      doc->error = ALI_ERROR_MEMORY_FAILURE;
+      return NULL;
+   }
+   dom->doc = doc;
+   dom->nodes = (dom_node *) (dom + 1);
+   dom->attributes = (dom_attribute *) (dom->nodes + counts.nodes_count + 1);
+
+   /* The document node holds the top level elements. */
+   n = dom_node_at(dom, 1);
+   n->name = (uint32_t) (start - doc->text);
+   n->name_size = 0;
+   n->content = n->name;
+   n->content_size = (uint32_t) (doc->text_end - start);
+   n->first_attribute = 0;
+   n->attributes = 0;
+   n->parent = 0;
+   n->first_child = 0;
+   n->next = 0;
+
+   dom->nodes_count = 1;
+   dom->attributes_count = 0;
+   dom->current = 1;
+   dom->previous = 0;
+   handler.start_element = add_dom_element;
+   handler.attribute = add_dom_attribute;
+   handler.end_element = end_dom_element;
+   doc->elements[0].pos = start;
+   if (!read_events(doc, &handler, dom))
+   {
+      ali_free(dom);
+      return NULL;
+   }
+
+   /* There is nothing left for ali_in. */
+   doc->elements[0].elements_read = true;
+
+   return dom;
+}
+
+
+/*! \brief Free a DOM made by ali_dom_build.
+ * 
+ * \see ali_dom_build */
+
+void
+ali_dom_free(
+   ali_dom * dom)               /*!< the DOM, or NULL */
+{
+   ali_free(dom);
+}
+
+
+/*! \brief Get the document node of a DOM.  Its children are the top level elements.
+ * 
+ * \see ali_dom_child */
+
+ali_node_ref
+ali_dom_root(
+   const ali_dom * dom)         /*!< the DOM to read */
+{
+   assert(dom != NULL);
+
+   return 1;
+}
+
+
+/*! \brief Find an element's first child with a name.
+ * 
+ * \return The child, or 0 if there is none or node is 0.
+ * 
+ * \see ali_dom_next */
+
+ali_node_ref
+ali_dom_child(
+   const ali_dom * dom,         /*!< the DOM to read */
+   ali_node_ref node,           /*!< the element */
+   const char *name)            /*!< the child's name.  NULL for any child. */
+{
+   ali_node_ref child;
+
+
+   assert(dom != NULL);
+   assert(node >= 0 && (uint32_t) node <= dom->nodes_count);
+
+   if (node == 0)
+      return 0;
+
+   child = dom_node_at(dom, node)->first_child;
+   while (child != 0 && name != NULL && 
+      !same_text(dom, dom_node_at(dom, child)->name, dom_node_at(dom, child)->name_size, name))
+   {
+      child = dom_node_at(dom, child)->next;
+   }
+
+   return child;
+}
+
+
+/*! \brief Find an element's next sibling with a name.
+ * 
+ * Use this after ali_dom_child to go through repeated elements.
+ * 
+ * \return The sibling, or 0 if there is none or node is 0.
+ * 
+ * \see ali_dom_child */
+
+ali_node_ref
+ali_dom_next(
+   const ali_dom * dom,         /*!< the DOM to read */
+   ali_node_ref node,           /*!< the element */
+   const char *name)            /*!< the sibling's name.  NULL for any sibling. */
+{
+   ali_node_ref next;
+
+
+   assert(dom != NULL);
+   assert(node >= 0 && (uint32_t) node <= dom->nodes_count);
+
+   if (node == 0)
+      return 0;
+
+   next = dom_node_at(dom, node)->next;
+   while (next != 0 && name != NULL && 
+      !same_text(dom, dom_node_at(dom, next)->name, dom_node_at(dom, next)->name_size, name))
+   {
+      next = dom_node_at(dom, next)->next;
+   }
+
+   return next;
+}
+
+
+/*! \brief Get the value of an element's attribute.
+ * 
+ * The value is as written, use ali_decode to convert its entities.
+ * 
+ * \return true if the element has the attribute.
+ * 
+ * \see ali_decode */
+
+bool
+ali_dom_attribute(
+   const ali_dom * dom,         /*!< the DOM to read */
+   ali_node_ref node,           /*!< the element */
+   const char *name,            /*!< the attribute's name */
+   ali_text * value)            /*!< set to the attribute's value */
+{
+   const dom_node *n;
+   const dom_attribute *a;
+   uint32_t i;
+
+
+   assert(dom != NULL);
+   assert(node >= 0 && (uint32_t) node <= dom->nodes_count);
+   assert(name != NULL);
+   assert(value != NULL);
+
+   if (node == 0)
+      return false;
+
+   n = dom_node_at(dom, node);
+   for (i = 0; i < n->attributes; i++)
+   {
+      a = &dom->attributes[n->first_attribute + i];
+      if (same_text(dom, a->name, a->name_size, name))
+      {
+         value->text = dom->doc->text + a->value;
+         value->size = a->value_size;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+/*! \brief Get an element's name.
+ * 
+ * \see ali_dom_content */
+
+ali_text
+ali_dom_name(
+   const ali_dom * dom,         /*!< the DOM to read */
+   ali_node_ref node)           /*!< the element */
+{
+   ali_text name;
+
+
+   assert(dom != NULL);
+   assert(node >= 0 && (uint32_t) node <= dom->nodes_count);
+
+   name.text = NULL;
+   name.size = 0;
+   if (node != 0)
+   {
+      name.text = dom->doc->text + dom_node_at(dom, node)->name;
+      name.size = dom_node_at(dom, node)->name_size;
+   }
+   return name;
+}
+
+
+/*! \brief Get the text between an element's start and end tags.
+ * 
+ * The text is as written, including any child elements.  For an element holding 
+ * only text, use ali_decode to get the text as ali_in would give it.
+ * 
+ * \see ali_decode */
+
+ali_text
+ali_dom_content(
+   const ali_dom * dom,         /*!< the DOM to read */
+   ali_node_ref node)           /*!< the element */
+{
+   ali_text content;
+
+
+   assert(dom != NULL);
+   assert(node >= 0 && (uint32_t) node <= dom->nodes_count);
+
+   content.text = NULL;
+   content.size = 0;
+   if (node != 0)
+   {
+      content.text = dom->doc->text + dom_node_at(dom, node)->content;
+      content.size = dom_node_at(dom, node)->content_size;
+   }
+   return content;
+}
+
+
 /*! \brief Get the error status of an Ali document.
  * 
  * A successfully read document will always have the status ALI_ERROR_NONE.  Once
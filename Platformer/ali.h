@@ -43,7 +43,9 @@
  * 
  * 3. Minimum resources are needed.  If elements are read in the order found, 
  * then little memory is needed to skip elements.  If elements are strangely
- * ordered, then more memory is needed but the data is correctly read.
+ * ordered, then more memory is needed but the data is correctly read.  When 
+ * the order isn't known at all, ali_dom_build reads the document once into 
+ * one block of memory that can be read in any order.
  * 
  * 
  * The disadvantages are
@@ -73,6 +75,11 @@ extern "C"
  * document is well formed. */
 #define ALI_OPTION_INPUT_XML_DECLARATION 0x00000002
 
+/*! ali_open reads the file into memory instead of mapping it.  Use this when
+ * the file may be truncated or rewritten while the document is open, which
+ * faults on a mapping. */
+#define ALI_OPTION_INPUT_COPY 0x00000004
+
 /*! \brief Convert input from UTF-8 to ISO-8859-1.
  * 
  * Useful to read XML in code running in legacy environments. 
@@ -168,8 +175,8 @@ extern "C"
 
 /*! \brief An ID number for the element. 
  *
- * Used to confirm operating at the right element. */
-    typedef int16_t ali_element_ref;
+ * Used to confirm operating at the right element, and to find it without a search. */
+    typedef int32_t ali_element_ref;
 
 /*! \brief Where in the document to input information from. */
     typedef struct ali_element_info ali_element_info;
@@ -177,6 +184,15 @@ extern "C"
 /*! \brief All information needed to read an XML document opened for input. */
     typedef struct ali_doc_info ali_doc_info;
 
+/*! \brief A format compiled by ali_compile, for ali_in_query. */
+    typedef struct ali_query ali_query;
+
+/*! \brief A document read into memory by ali_dom_build. */
+    typedef struct ali_dom ali_dom;
+
+/*! \brief An element in an ali_dom.  0 means none. */
+    typedef int32_t ali_node_ref;
+
 
 /*! \brief Called to handle matching XML elements.  
  * 
@@ -198,14 +214,69 @@ extern "C"
     typedef void ali_element_function(ali_doc_info *doc,
         ali_element_ref element, void *data);
 
+/*! \brief A run of chars in the input.  It is not NUL terminated. */
+    typedef struct ali_text
+    {
+        const char *text;
+        uint32_t size;
+    } ali_text;
+
+/*! \brief The functions ali_parse calls as it reads a document. 
+ * 
+ * Any of them can be NULL.  data is the data passed to ali_open. */
+    typedef struct ali_handler
+    {
+        void (*start_element)(ali_doc_info *doc, ali_text name, void *data);
+        void (*attribute)(ali_doc_info *doc, ali_text name, ali_text value, void *data);
+        void (*content)(ali_doc_info *doc, ali_text text, void *data);
+        void (*end_element)(ali_doc_info *doc, ali_text name, void *data);
+    } ali_handler;
+
     extern ali_element_ref ali_open(ali_doc_info **doc, const char *file_name,
         uint32_t options, void *data);
 
+    extern ali_element_ref ali_open_memory(ali_doc_info **doc, const char *buffer,
+        uint32_t size, uint32_t options, void *data);
+
     extern void ali_close(ali_doc_info *doc);
 
     extern ali_element_ref ali_in(ali_doc_info *doc, ali_element_ref element,
         const char *format, ...);
 
+    extern ali_query *ali_compile(const char *format);
+
+    extern void ali_free_query(ali_query *query);
+
+    extern ali_element_ref ali_in_query(ali_doc_info *doc, ali_element_ref element,
+        const ali_query *query, ...);
+
+    extern bool ali_skip(ali_doc_info *doc, ali_element_ref element,
+        const char **text, uint32_t *size);
+
+    extern bool ali_parse(ali_doc_info *doc, const ali_handler *handler);
+
+    extern uint32_t ali_decode(ali_doc_info *doc, ali_text text, char *dest,
+        uint32_t dest_size);
+
+    extern ali_dom *ali_dom_build(ali_doc_info *doc);
+
+    extern void ali_dom_free(ali_dom *dom);
+
+    extern ali_node_ref ali_dom_root(const ali_dom *dom);
+
+    extern ali_node_ref ali_dom_child(const ali_dom *dom, ali_node_ref node,
+        const char *name);
+
+    extern ali_node_ref ali_dom_next(const ali_dom *dom, ali_node_ref node,
+        const char *name);
+
+    extern bool ali_dom_attribute(const ali_dom *dom, ali_node_ref node,
+        const char *name, ali_text *value);
+
+    extern ali_text ali_dom_name(const ali_dom *dom, ali_node_ref node);
+
+    extern ali_text ali_dom_content(const ali_dom *dom, ali_node_ref node);
+
     extern bool ali_is_element_new(const ali_doc_info *doc,
         ali_element_ref element);
 
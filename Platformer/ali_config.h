@@ -24,12 +24,25 @@ typedef unsigned int uint_t;
 #endif
 
 #include <stdio.h>
-#include <setjmp.h>
 #include <string.h>
 #include <malloc.h>
 #include <assert.h>
 #include <stdarg.h>
 
+/* Ali's own memory: documents, their element stacks and text, queries and 
+ * DOMs.  Strings given to the caller ("%as", "%ap") stay on malloc, since the 
+ * caller frees them.  A project puts Ali on its own allocator by defining 
+ * ali_malloc, ali_realloc and ali_free, or by naming a header that does in 
+ * ALI_CONFIG_USER_H (e.g. -DALI_CONFIG_USER_H="\"my_alloc.h\""). */
+#if defined(ALI_CONFIG_USER_H)
+#include ALI_CONFIG_USER_H
+#endif
+#ifndef ali_malloc
+#define ali_malloc(size) malloc(size)
+#define ali_realloc(p, size) realloc(p, size)
+#define ali_free(p) free(p)
+#endif
+
 #ifndef __cplusplus
 typedef unsigned char bool;
 #define true (!0)
@@ -5,42 +5,45 @@
 #include "DrawableObject.h"
 #include "Block.h"
 #include "PlayerCharacter.h"
+#include "AllocTracker.h"
 #include "main.h"
 #include <string.h>
 
 GameManager Mgr;
 sf::RenderWindow window;
 
-int main()
+int main(int argc, char ** argv)
 {
+	bool lazy_animation = false; // --lazy-animation: work out slides while drawing instead of in the timing wheel
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--lazy-animation") == 0)
+			lazy_animation = true;
+
 	//setlocale(LC_ALL, "RUSSIAN");
 
 	window.create(VideoMode(500, 500), L"Block");
 
 	Mgr.initAnimationLoader(NULL);
+	Mgr.getAnimationLoader()->startWatching(); // pick up edits to animations.data without a restart
+	Mgr.getAnimationSystem()->setLazy(lazy_animation);
 		
-	Vector2f coords = Vector2f(0, 0);
-	Vector2f size = Vector2f(50, 50);
+	Mgr.getPool<Block>()->warmUp(100); // the whole level in one slab per type
+	Mgr.getPool<PlayerCharacter>()->warmUp(4);
+
+	Vector2f coords[100];
 	for (int i = 0; i < 10; i++)
 		for (int j = 0; j < 10; j++)
-		{
-			coords.x = j * 50; coords.y = i * 50;
-			Mgr.addNewObject(new Block(coords, size));
-		}
+			coords[i * 10 + j] = Vector2f(j * 50, i * 50);
+	spawnMany<Block>(DrawableObject::makePrefab(TK_STATICBLOCK_GROUND, AK_IDLE_FIRST), coords, 100);
 	
-	PlayerCharacter * pc = new PlayerCharacter(Vector2f(100,100), Vector2f(80,96));
-	pc->playAnimation("WALK", "LEFT");
-	Mgr.addNewObject(pc);
-	pc = new PlayerCharacter(Vector2f(100, 300), Vector2f(80, 96));
-	pc->playAnimation("WALK", "RIGHT");
-	Mgr.addNewObject(pc);
-	pc = new PlayerCharacter(Vector2f(300, 300), Vector2f(80, 96));
-	pc->playAnimation("WALK", "LEFT");
-	Mgr.addNewObject(pc);
-	pc = new PlayerCharacter(Vector2f(300, 100), Vector2f(80, 96));
-	pc->playAnimation("WALK", "RIGHT");
-	Mgr.addNewObject(pc);
-
+	PlayerCharacter * pc = Mgr.spawn<PlayerCharacter>(Vector2f(100,100), Vector2f(80,96));
+	pc->playAnimation(AK_WALK_LEFT);
+	pc = Mgr.spawn<PlayerCharacter>(Vector2f(100, 300), Vector2f(80, 96));
+	pc->playAnimation(AK_WALK_RIGHT);
+	pc = Mgr.spawn<PlayerCharacter>(Vector2f(300, 300), Vector2f(80, 96));
+	pc->playAnimation(AK_WALK_LEFT);
+	pc = Mgr.spawn<PlayerCharacter>(Vector2f(300, 100), Vector2f(80, 96));
+	pc->playAnimation(AK_WALK_RIGHT);
 
 	
 	/*auto start = std::chrono::high_resolution_clock::now();
@@ -57,8 +60,9 @@ int main()
 	text.setColor(Color::Red);//   .    ,     
 	text.setStyle(Text::Bold);
 	text.setPosition(20, 20);
-	char fps[10];
+	char fps[64];
 	int fps_counter = 0, fps_av = 0, fps_elapsed = 0;;
+	uint64_t frame_allocs = 0, frame_bytes = 0;
 
 	while (window.isOpen())
 	{
@@ -76,9 +80,12 @@ int main()
 		micros = clock.getElapsedTime().asMicroseconds();
 		clock.restart();
 		
+		AllocTracker::beginFrame();
 		Mgr.Update(micros);
 		window.clear();
 		Mgr.Draw();
+		frame_allocs = AllocTracker::getFrameAllocs();
+		frame_bytes = AllocTracker::getFrameBytes();
 		
 		
 		fps_av += 1000000 / micros;
@@ -86,7 +93,11 @@ int main()
 		fps_elapsed += micros;
 		if (fps_elapsed>=500000)
 		{
-			_itoa_s(fps_av / fps_counter, fps, 10);
+			AllocScope tag(ALLOC_UI);
+			if (AllocTracker::isEnabled()) // fps, sprites rebuilt, heap allocations and bytes in last frame's Update/Draw
+				sprintf_s(fps, "%d  %u  %llu/%llu", fps_av / fps_counter, Mgr.getSpriteUpdates(), (unsigned long long)frame_allocs, (unsigned long long)frame_bytes);
+			else
+				sprintf_s(fps, "%d  %u", fps_av / fps_counter, Mgr.getSpriteUpdates()); // fps, sprites rebuilt last frame
 			text.setString(fps);
 			fps_av = 0;
 			fps_counter = 0;
@@ -95,7 +106,10 @@ int main()
 
 		window.draw(text);
 		window.display();
+		Mgr.getFrameArena()->reset(); // frame-temporary data ends here
 	}
 
+	Mgr.printPoolReport();
+	AllocTracker::printReport();
 	return 0;
 }
\ No newline at end of file